@@ -0,0 +1,860 @@
+// Microbenchmarks for dw::ThreadPool.
+//
+// Every benchmark runs once per worker count in the sweep and reports the median of several repetitions as one
+// line of JSON (or CSV). Passing an earlier JSON run as --baseline adds the relative change per line and makes the
+// process exit with 2 if anything got slower than --threshold allows.
+//
+//   dwtp_bench [--workers 1,2,4,8] [--repeat 5] [--quick] [--filter name] [--affinity none|core|node]
+//              [--format json|csv] [--output file] [--baseline file] [--threshold 0.1]
+
+#include <thread_pool.hpp>
+#include <algorithms.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct Config
+{
+    std::vector<uint32_t> workers;
+    uint32_t              repeat;
+    bool                  quick;
+    const char*           filter;
+    dw::WorkerAffinity    affinity;
+    bool                  csv;
+    const char*           output;
+    const char*           baseline;
+    double                threshold;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// What one repetition of a benchmark measured.
+struct Sample
+{
+    uint64_t ns;
+    uint64_t tasks;
+};
+
+typedef Sample (*BenchmarkFunction)(dw::ThreadPool& pool, const Config& config);
+
+struct Benchmark
+{
+    const char*       name;
+    BenchmarkFunction function;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct Result
+{
+    std::string name;
+    uint32_t    workers;
+    uint64_t    tasks;
+    uint64_t    ns;
+    uint64_t    min_ns;
+    double      ns_per_task;
+    double      tasks_per_sec;
+    double      speedup;
+    double      efficiency;
+    double      baseline_ns_per_task;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static inline uint64_t now()
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Keeps the optimizer from throwing away work whose result is otherwise unused.
+static volatile float g_sink;
+
+// Roughly the same amount of ALU work on every call, scaled by iterations.
+static inline float burn(float x, uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i++)
+        x = x * 0.999f + std::sqrt(x + 1.0f) * 0.001f;
+
+    return x;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void empty_task(void*) {}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Allocate and enqueue empty tasks one at a time from the main thread, then drain.
+static Sample bench_empty_tasks(dw::ThreadPool& pool, const Config& config)
+{
+    const uint32_t num_tasks = config.quick ? 20000 : 200000;
+    const uint64_t start = now();
+
+    for (uint32_t i = 0; i < num_tasks; i++)
+    {
+        dw::Task* task = pool.allocate();
+        task->function = empty_task;
+        pool.enqueue(task);
+    }
+
+    pool.wait_for_all();
+
+    Sample sample = { now() - start, num_tasks };
+    return sample;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Same work as empty_tasks, submitted through allocate_batch/enqueue_batch.
+static Sample bench_empty_tasks_batch(dw::ThreadPool& pool, const Config& config)
+{
+    const uint32_t         num_tasks = config.quick ? 20000 : 200000;
+    const uint32_t         batch_size = 1024;
+    std::vector<dw::Task*> batch(batch_size);
+    const uint64_t         start = now();
+
+    for (uint32_t i = 0; i < num_tasks; i += batch_size)
+    {
+        const uint32_t count = std::min(batch_size, num_tasks - i);
+
+        pool.allocate_batch(&batch[0], count);
+
+        for (uint32_t j = 0; j < count; j++)
+            batch[j]->function = empty_task;
+
+        pool.enqueue_batch(&batch[0], count);
+    }
+
+    pool.wait_for_all();
+
+    Sample sample = { now() - start, num_tasks };
+    return sample;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct SpawnData
+{
+    dw::ThreadPool* pool;
+    uint32_t        depth;
+};
+
+static void spawn_task(void* data)
+{
+    SpawnData spawn = *static_cast<SpawnData*>(data);
+
+    if (spawn.depth == 0)
+        return;
+
+    spawn.depth--;
+
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        dw::Task* child = spawn.pool->allocate();
+        child->function = spawn_task;
+        *dw::task_data<SpawnData>(child) = spawn;
+        spawn.pool->enqueue(child);
+    }
+}
+
+// Fork: a binary tree of tasks spawned from inside the workers, so it is all deque pushes and steals.
+static Sample bench_fan_out(dw::ThreadPool& pool, const Config& config)
+{
+    const uint32_t depth = config.quick ? 12 : 16;
+    SpawnData      root = { &pool, depth };
+    const uint64_t start = now();
+
+    dw::Task* task = pool.allocate();
+    task->function = spawn_task;
+    *dw::task_data<SpawnData>(task) = root;
+    pool.enqueue(task);
+    pool.wait_for_all();
+
+    Sample sample = { now() - start, (uint64_t(2) << depth) - 1 };
+    return sample;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Join: groups of DefaultThreadPoolTraits::MAX_DEPENDENCIES leaves that all have to finish before their join task can run.
+static Sample bench_fan_in(dw::ThreadPool& pool, const Config& config)
+{
+    const uint32_t         num_groups = config.quick ? 256 : 4096;
+    const uint32_t         group_size = dw::DefaultThreadPoolTraits::MAX_DEPENDENCIES;
+    std::vector<dw::Task*> tasks(group_size + 1);
+    const uint64_t         start = now();
+
+    for (uint32_t i = 0; i < num_groups; i++)
+    {
+        pool.allocate_batch(&tasks[0], group_size + 1);
+
+        dw::Task* join = tasks[group_size];
+        join->function = empty_task;
+
+        for (uint32_t j = 0; j < group_size; j++)
+        {
+            tasks[j]->function = empty_task;
+            pool.define_dependency(join, tasks[j]);
+        }
+
+        pool.enqueue_batch(&tasks[0], group_size + 1);
+    }
+
+    pool.wait_for_all();
+
+    Sample sample = { now() - start, uint64_t(num_groups) * (group_size + 1) };
+    return sample;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// One long continuation chain, built up front. Nothing can run in parallel, this is pure dispatch latency.
+static Sample bench_dependency_chain(dw::ThreadPool& pool, const Config& config)
+{
+    const uint32_t         length = config.quick ? 5000 : 50000;
+    std::vector<dw::Task*> chain(length);
+
+    pool.allocate_batch(&chain[0], length);
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        chain[i]->function = empty_task;
+
+        if (i > 0)
+            pool.define_continuation(chain[i - 1], chain[i]);
+    }
+
+    const uint64_t start = now();
+
+    pool.enqueue(chain[0]);
+    pool.wait_for_all();
+
+    Sample sample = { now() - start, length };
+    return sample;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+#define ECS_NUM_SYSTEMS 8u
+#define ECS_NUM_CHUNKS 16u
+#define ECS_CHUNK_SIZE 1024u
+#define ECS_WORK 16u
+
+struct EcsChunk
+{
+    float* values;
+};
+
+static void ecs_system(void* data)
+{
+    float* values = static_cast<EcsChunk*>(data)->values;
+
+    for (uint32_t i = 0; i < ECS_CHUNK_SIZE; i++)
+        values[i] = burn(values[i], ECS_WORK);
+}
+
+// The frame from example/unit_test.cpp, widened: every system is split into chunks of entities and chunk i of a
+// system only waits for chunk i of the systems before it. Built once as a TaskGraph and launched every frame.
+static Sample bench_ecs_dag(dw::ThreadPool& pool, const Config& config)
+{
+    // animation_pre -> transform -> physics_sync
+    //                            -> animation_post, audio_listener, audio_source, particles -> scripts
+    static const uint32_t edges[][2] = { { 0, 1 }, { 0, 2 }, { 1, 3 }, { 1, 4 }, { 1, 5 }, { 1, 6 }, { 3, 7 }, { 4, 7 }, { 5, 7 }, { 6, 7 } };
+
+    const uint32_t     num_frames = config.quick ? 10 : 100;
+    std::vector<float> values(ECS_NUM_SYSTEMS * ECS_NUM_CHUNKS * ECS_CHUNK_SIZE, 1.0f);
+    dw::TaskGraph      graph;
+
+    for (uint32_t system = 0; system < ECS_NUM_SYSTEMS; system++)
+    {
+        for (uint32_t chunk = 0; chunk < ECS_NUM_CHUNKS; chunk++)
+        {
+            const uint32_t node = graph.add_node(ecs_system);
+            graph.node_data<EcsChunk>(node)->values = &values[(system * ECS_NUM_CHUNKS + chunk) * ECS_CHUNK_SIZE];
+        }
+    }
+
+    for (uint32_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++)
+    {
+        for (uint32_t chunk = 0; chunk < ECS_NUM_CHUNKS; chunk++)
+            graph.precede(edges[i][0] * ECS_NUM_CHUNKS + chunk, edges[i][1] * ECS_NUM_CHUNKS + chunk);
+    }
+
+    graph.compile();
+
+    const uint64_t start = now();
+
+    for (uint32_t frame = 0; frame < num_frames; frame++)
+    {
+        pool.run(graph);
+        pool.wait_for_graph(graph);
+    }
+
+    Sample sample = { now() - start, uint64_t(num_frames) * graph.num_nodes() };
+
+    g_sink = values[0];
+    return sample;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Memory bound: a[i] = a[i] * s + b[i] over arrays much larger than the caches. Run it with --affinity core/node to
+// see what pinning and locality-aware stealing do. Tasks are counted as grain sized chunks.
+static Sample bench_parallel_for_memory(dw::ThreadPool& pool, const Config& config)
+{
+    const uint32_t     num_elements = config.quick ? (1u << 20) : (1u << 24);
+    const uint32_t     grain = 16384;
+    const uint32_t     num_passes = 4;
+    std::vector<float> a(num_elements, 1.0f);
+    std::vector<float> b(num_elements, 2.0f);
+    float*             a_ptr = &a[0];
+    const float*       b_ptr = &b[0];
+
+    const uint64_t start = now();
+
+    for (uint32_t pass = 0; pass < num_passes; pass++)
+    {
+        pool.parallel_for(0, num_elements, grain, [=](uint32_t i) {
+            a_ptr[i] = a_ptr[i] * 0.5f + b_ptr[i];
+        });
+    }
+
+    Sample sample = { now() - start, uint64_t(num_passes) * (num_elements / grain) };
+
+    g_sink = a[num_elements / 2];
+    return sample;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Compute bound loop with uneven per element cost, so splitting and stealing have to balance it.
+static Sample bench_parallel_for_compute(dw::ThreadPool& pool, const Config& config)
+{
+    const uint32_t     num_elements = config.quick ? (1u << 14) : (1u << 17);
+    const uint32_t     grain = 256;
+    std::vector<float> values(num_elements, 1.0f);
+    float*             values_ptr = &values[0];
+
+    const uint64_t start = now();
+
+    pool.parallel_for(0, num_elements, grain, [=](uint32_t i) {
+        values_ptr[i] = burn(values_ptr[i], 16 + (i % 64));
+    });
+
+    Sample sample = { now() - start, num_elements / grain };
+
+    g_sink = values[num_elements / 2];
+    return sample;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Several threads outside the pool enqueue at the same time, all of it lands on the shared injection queue.
+static Sample bench_multi_producer(dw::ThreadPool& pool, const Config& config)
+{
+    const uint32_t           num_producers = 4;
+    const uint32_t           tasks_per_producer = config.quick ? 5000 : 50000;
+    std::vector<std::thread> producers;
+    const uint64_t           start = now();
+
+    for (uint32_t i = 0; i < num_producers; i++)
+    {
+        producers.push_back(std::thread([&pool, tasks_per_producer]() {
+            for (uint32_t j = 0; j < tasks_per_producer; j++)
+            {
+                dw::Task* task = pool.allocate();
+                task->function = empty_task;
+                pool.enqueue(task);
+            }
+        }));
+    }
+
+    for (uint32_t i = 0; i < num_producers; i++)
+        producers[i].join();
+
+    pool.wait_for_all();
+
+    Sample sample = { now() - start, uint64_t(num_producers) * tasks_per_producer };
+    return sample;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// The algorithm benchmarks run at 1e4, 1e6 and 1e8 elements, next to the sequential standard library version where
+// there is one. --quick caps them at 1e6. Tasks are counted as elements, so ns_per_task is the time per element.
+static inline uint32_t num_algorithm_elements(uint32_t count, const Config& config)
+{
+    return config.quick ? std::min(count, 1000000u) : count;
+}
+
+// Same pseudo random keys on every repetition, generated before the clock starts.
+static void random_keys(std::vector<uint32_t>& keys, uint32_t count)
+{
+    uint32_t state = 0x9E3779B9u;
+
+    keys.resize(count);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        keys[i] = state;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+template <uint32_t N>
+static Sample bench_sort(dw::ThreadPool& pool, const Config& config)
+{
+    const uint32_t        num_elements = num_algorithm_elements(N, config);
+    std::vector<uint32_t> keys;
+    random_keys(keys, num_elements);
+
+    const uint64_t start = now();
+
+    dw::algorithms::sort(pool, keys.begin(), keys.end());
+
+    Sample sample = { now() - start, num_elements };
+
+    g_sink = float(keys[num_elements / 2]);
+    return sample;
+}
+
+template <uint32_t N>
+static Sample bench_std_sort(dw::ThreadPool&, const Config& config)
+{
+    const uint32_t        num_elements = num_algorithm_elements(N, config);
+    std::vector<uint32_t> keys;
+    random_keys(keys, num_elements);
+
+    const uint64_t start = now();
+
+    std::sort(keys.begin(), keys.end());
+
+    Sample sample = { now() - start, num_elements };
+
+    g_sink = float(keys[num_elements / 2]);
+    return sample;
+}
+
+template <uint32_t N>
+static Sample bench_radix_sort(dw::ThreadPool& pool, const Config& config)
+{
+    const uint32_t        num_elements = num_algorithm_elements(N, config);
+    std::vector<uint32_t> keys;
+    random_keys(keys, num_elements);
+
+    const uint64_t start = now();
+
+    dw::algorithms::radix_sort(pool, keys.begin(), keys.end());
+
+    Sample sample = { now() - start, num_elements };
+
+    g_sink = float(keys[num_elements / 2]);
+    return sample;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+template <uint32_t N>
+static Sample bench_inclusive_scan(dw::ThreadPool& pool, const Config& config)
+{
+    const uint32_t        num_elements = num_algorithm_elements(N, config);
+    std::vector<uint32_t> values(num_elements, 1u);
+    std::vector<uint32_t> sums(num_elements);
+
+    const uint64_t start = now();
+
+    dw::algorithms::inclusive_scan(pool, values.begin(), values.end(), sums.begin());
+
+    Sample sample = { now() - start, num_elements };
+
+    g_sink = float(sums[num_elements - 1]);
+    return sample;
+}
+
+// std::inclusive_scan needs C++17, std::partial_sum is the same sequential loop before that.
+template <uint32_t N>
+static Sample bench_std_inclusive_scan(dw::ThreadPool&, const Config& config)
+{
+    const uint32_t        num_elements = num_algorithm_elements(N, config);
+    std::vector<uint32_t> values(num_elements, 1u);
+    std::vector<uint32_t> sums(num_elements);
+
+    const uint64_t start = now();
+
+#if __cplusplus >= 201703L
+    std::inclusive_scan(values.begin(), values.end(), sums.begin());
+#else
+    std::partial_sum(values.begin(), values.end(), sums.begin());
+#endif
+
+    Sample sample = { now() - start, num_elements };
+
+    g_sink = float(sums[num_elements - 1]);
+    return sample;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+template <uint32_t N>
+static Sample bench_copy_if(dw::ThreadPool& pool, const Config& config)
+{
+    const uint32_t        num_elements = num_algorithm_elements(N, config);
+    std::vector<uint32_t> keys;
+    std::vector<uint32_t> selected(num_elements);
+    random_keys(keys, num_elements);
+
+    const uint64_t start = now();
+
+    std::vector<uint32_t>::iterator last = dw::algorithms::copy_if(pool, keys.begin(), keys.end(), selected.begin(), [](uint32_t key) {
+        return (key & 1u) != 0;
+    });
+
+    Sample sample = { now() - start, num_elements };
+
+    g_sink = float(last - selected.begin());
+    return sample;
+}
+
+template <uint32_t N>
+static Sample bench_transform_reduce(dw::ThreadPool& pool, const Config& config)
+{
+    const uint32_t     num_elements = num_algorithm_elements(N, config);
+    std::vector<float> values(num_elements, 0.5f);
+
+    const uint64_t start = now();
+
+    const double sum = dw::algorithms::transform_reduce(pool, values.begin(), values.end(), 0.0, std::plus<double>(), [](float x) {
+        return double(x) * double(x);
+    });
+
+    Sample sample = { now() - start, num_elements };
+
+    g_sink = float(sum);
+    return sample;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static const Benchmark g_benchmarks[] = {
+    { "empty_tasks", bench_empty_tasks },
+    { "empty_tasks_batch", bench_empty_tasks_batch },
+    { "fan_out", bench_fan_out },
+    { "fan_in", bench_fan_in },
+    { "dependency_chain", bench_dependency_chain },
+    { "ecs_dag", bench_ecs_dag },
+    { "parallel_for_memory", bench_parallel_for_memory },
+    { "parallel_for_compute", bench_parallel_for_compute },
+    { "multi_producer", bench_multi_producer },
+    { "sort_1e4", bench_sort<10000> },
+    { "sort_1e6", bench_sort<1000000> },
+    { "sort_1e8", bench_sort<100000000> },
+    { "std_sort_1e4", bench_std_sort<10000> },
+    { "std_sort_1e6", bench_std_sort<1000000> },
+    { "std_sort_1e8", bench_std_sort<100000000> },
+    { "radix_sort_1e4", bench_radix_sort<10000> },
+    { "radix_sort_1e6", bench_radix_sort<1000000> },
+    { "radix_sort_1e8", bench_radix_sort<100000000> },
+    { "inclusive_scan_1e4", bench_inclusive_scan<10000> },
+    { "inclusive_scan_1e6", bench_inclusive_scan<1000000> },
+    { "inclusive_scan_1e8", bench_inclusive_scan<100000000> },
+    { "std_inclusive_scan_1e4", bench_std_inclusive_scan<10000> },
+    { "std_inclusive_scan_1e6", bench_std_inclusive_scan<1000000> },
+    { "std_inclusive_scan_1e8", bench_std_inclusive_scan<100000000> },
+    { "copy_if_1e6", bench_copy_if<1000000> },
+    { "transform_reduce_1e6", bench_transform_reduce<1000000> },
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Reads the lines written by print_result() in JSON mode. Anything else in the file is ignored.
+static bool load_baseline(const char* path, std::vector<Result>& baseline)
+{
+    FILE* file = fopen(path, "r");
+
+    if (!file)
+        return false;
+
+    char line[1024];
+
+    while (fgets(line, sizeof(line), file))
+    {
+        char     name[128];
+        Result   result;
+        unsigned workers = 0;
+
+        const char* begin = strstr(line, "{\"benchmark\"");
+
+        if (!begin || sscanf(begin, "{\"benchmark\": \"%127[^\"]\", \"workers\": %u,", name, &workers) != 2)
+            continue;
+
+        const char* ns_per_task = strstr(begin, "\"ns_per_task\": ");
+
+        if (!ns_per_task)
+            continue;
+
+        result.name = name;
+        result.workers = workers;
+        result.ns_per_task = atof(ns_per_task + strlen("\"ns_per_task\": "));
+        baseline.push_back(result);
+    }
+
+    fclose(file);
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void print_result(FILE* file, const Config& config, const Result& result)
+{
+    if (config.csv)
+    {
+        fprintf(file, "%s,%u,%llu,%llu,%llu,%.3f,%.1f,%.3f,%.3f", result.name.c_str(), result.workers, (unsigned long long)result.tasks, (unsigned long long)result.ns, (unsigned long long)result.min_ns, result.ns_per_task, result.tasks_per_sec, result.speedup, result.efficiency);
+
+        if (result.baseline_ns_per_task > 0.0)
+            fprintf(file, ",%.3f,%.4f", result.baseline_ns_per_task, result.ns_per_task / result.baseline_ns_per_task - 1.0);
+        else if (config.baseline)
+            fprintf(file, ",,");
+
+        fprintf(file, "\n");
+    }
+    else
+    {
+        fprintf(file, "    {\"benchmark\": \"%s\", \"workers\": %u, \"tasks\": %llu, \"ns\": %llu, \"min_ns\": %llu, \"ns_per_task\": %.3f, \"tasks_per_sec\": %.1f, \"speedup\": %.3f, \"efficiency\": %.3f", result.name.c_str(), result.workers, (unsigned long long)result.tasks, (unsigned long long)result.ns, (unsigned long long)result.min_ns, result.ns_per_task, result.tasks_per_sec, result.speedup, result.efficiency);
+
+        if (result.baseline_ns_per_task > 0.0)
+            fprintf(file, ", \"baseline_ns_per_task\": %.3f, \"change\": %.4f", result.baseline_ns_per_task, result.ns_per_task / result.baseline_ns_per_task - 1.0);
+
+        fprintf(file, "}");
+    }
+
+    fflush(file);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void parse_workers(const char* text, std::vector<uint32_t>& workers)
+{
+    workers.clear();
+
+    while (*text)
+    {
+        char*               end = nullptr;
+        const unsigned long count = strtoul(text, &end, 10);
+
+        if (end == text)
+            break;
+
+        if (count > 0)
+            workers.push_back(uint32_t(count));
+
+        text = *end == ',' ? end + 1 : end;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void print_usage()
+{
+    fprintf(stderr, "usage: dwtp_bench [--workers 1,2,4] [--repeat N] [--quick] [--filter name] [--affinity none|core|node]\n"
+                    "                  [--format json|csv] [--output file] [--baseline file] [--threshold 0.1] [--list]\n");
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    Config config;
+    config.repeat = 5;
+    config.quick = false;
+    config.filter = nullptr;
+    config.affinity = dw::WorkerAffinity::NONE;
+    config.csv = false;
+    config.output = nullptr;
+    config.baseline = nullptr;
+    config.threshold = 0.1;
+
+    const uint32_t num_hardware_threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    // Powers of two up to the machine, plus the machine itself.
+    for (uint32_t count = 1; count < num_hardware_threads; count *= 2)
+        config.workers.push_back(count);
+
+    config.workers.push_back(num_hardware_threads);
+
+    for (int i = 1; i < argc; i++)
+    {
+        const bool has_value = i + 1 < argc;
+
+        if (strcmp(argv[i], "--workers") == 0 && has_value)
+            parse_workers(argv[++i], config.workers);
+        else if (strcmp(argv[i], "--repeat") == 0 && has_value)
+            config.repeat = std::max(uint32_t(atoi(argv[++i])), 1u);
+        else if (strcmp(argv[i], "--quick") == 0)
+            config.quick = true;
+        else if (strcmp(argv[i], "--filter") == 0 && has_value)
+            config.filter = argv[++i];
+        else if (strcmp(argv[i], "--affinity") == 0 && has_value)
+        {
+            const char* affinity = argv[++i];
+            config.affinity = strcmp(affinity, "core") == 0 ? dw::WorkerAffinity::CORE : strcmp(affinity, "node") == 0 ? dw::WorkerAffinity::NODE : dw::WorkerAffinity::NONE;
+        }
+        else if (strcmp(argv[i], "--format") == 0 && has_value)
+            config.csv = strcmp(argv[++i], "csv") == 0;
+        else if (strcmp(argv[i], "--output") == 0 && has_value)
+            config.output = argv[++i];
+        else if (strcmp(argv[i], "--baseline") == 0 && has_value)
+            config.baseline = argv[++i];
+        else if (strcmp(argv[i], "--threshold") == 0 && has_value)
+            config.threshold = atof(argv[++i]);
+        else if (strcmp(argv[i], "--list") == 0)
+        {
+            for (uint32_t j = 0; j < sizeof(g_benchmarks) / sizeof(g_benchmarks[0]); j++)
+                printf("%s\n", g_benchmarks[j].name);
+
+            return 0;
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    std::vector<Result> baseline;
+
+    if (config.baseline && !load_baseline(config.baseline, baseline))
+    {
+        fprintf(stderr, "dwtp_bench: can't read baseline %s\n", config.baseline);
+        return 1;
+    }
+
+    FILE* file = config.output ? fopen(config.output, "w") : stdout;
+
+    if (!file)
+    {
+        fprintf(stderr, "dwtp_bench: can't write %s\n", config.output);
+        return 1;
+    }
+
+    // The pool caps workers at the number of usable CPUs, so sweep over what it will actually create.
+    std::vector<uint32_t> sweep;
+
+    for (size_t i = 0; i < config.workers.size(); i++)
+    {
+        const uint32_t count = std::min(config.workers[i], num_hardware_threads);
+
+        if (std::find(sweep.begin(), sweep.end(), count) == sweep.end())
+            sweep.push_back(count);
+    }
+
+    std::sort(sweep.begin(), sweep.end());
+
+#if defined(NDEBUG) || defined(__OPTIMIZE__)
+    const bool optimized = true;
+#else
+    const bool optimized = false;
+#endif
+
+    if (!optimized)
+        fprintf(stderr, "dwtp_bench: built without optimizations, numbers are not representative\n");
+
+    static const char* affinity_names[] = { "none", "core", "node" };
+
+    if (config.csv)
+        fprintf(file, "benchmark,workers,tasks,ns,min_ns,ns_per_task,tasks_per_sec,speedup,efficiency%s\n", config.baseline ? ",baseline_ns_per_task,change" : "");
+    else
+    {
+        fprintf(file, "{\n  \"meta\": {\"hardware_threads\": %u, \"affinity\": \"%s\", \"repeat\": %u, \"quick\": %s, \"optimized\": %s, \"task_bytes\": %u, \"edge_bytes\": %u, \"task_payload_bytes\": %u},\n  \"results\": [\n",
+                num_hardware_threads, affinity_names[uint32_t(config.affinity)], config.repeat, config.quick ? "true" : "false", optimized ? "true" : "false", uint32_t(sizeof(dw::Task)), uint32_t(sizeof(dw::TaskEdges)), uint32_t(dw::DefaultThreadPoolTraits::TASK_SIZE_BYTES));
+    }
+
+    std::vector<Result> results;
+    bool                regressed = false;
+
+    for (uint32_t b = 0; b < sizeof(g_benchmarks) / sizeof(g_benchmarks[0]); b++)
+    {
+        const Benchmark& benchmark = g_benchmarks[b];
+
+        if (config.filter && !strstr(benchmark.name, config.filter))
+            continue;
+
+        double reference_ns_per_task = 0.0;
+
+        for (size_t w = 0; w < sweep.size(); w++)
+        {
+            dw::ThreadPool        pool(sweep[w], config.affinity);
+            std::vector<uint64_t> times;
+            Sample                sample = benchmark.function(pool, config); // Warm up caches and task slabs.
+
+            for (uint32_t r = 0; r < config.repeat; r++)
+            {
+                sample = benchmark.function(pool, config);
+                times.push_back(sample.ns);
+            }
+
+            std::sort(times.begin(), times.end());
+
+            Result result;
+            result.name = benchmark.name;
+            result.workers = pool.num_worker_threads();
+            result.tasks = sample.tasks;
+            result.ns = times[times.size() / 2];
+            result.min_ns = times[0];
+            result.ns_per_task = double(result.ns) / double(std::max(result.tasks, uint64_t(1)));
+            result.tasks_per_sec = result.ns ? double(result.tasks) * 1e9 / double(result.ns) : 0.0;
+            result.baseline_ns_per_task = 0.0;
+
+            // Scaling is relative to the smallest worker count of the sweep.
+            if (w == 0)
+                reference_ns_per_task = result.ns_per_task;
+
+            result.speedup = result.ns_per_task > 0.0 ? reference_ns_per_task / result.ns_per_task : 0.0;
+            result.efficiency = result.speedup * double(sweep[0]) / double(result.workers);
+
+            for (size_t i = 0; i < baseline.size(); i++)
+            {
+                if (baseline[i].name == result.name && baseline[i].workers == result.workers)
+                {
+                    result.baseline_ns_per_task = baseline[i].ns_per_task;
+
+                    if (result.ns_per_task > baseline[i].ns_per_task * (1.0 + config.threshold))
+                    {
+                        regressed = true;
+                        fprintf(stderr, "dwtp_bench: %s with %u workers regressed from %.3f to %.3f ns/task\n", result.name.c_str(), result.workers, baseline[i].ns_per_task, result.ns_per_task);
+                    }
+                }
+            }
+
+            // Results go out as they come in, so the separator is written in front of every line but the first.
+            if (!config.csv && !results.empty())
+                fprintf(file, ",\n");
+
+            results.push_back(result);
+            print_result(file, config, result);
+        }
+    }
+
+    if (!config.csv)
+        fprintf(file, "\n  ]\n}\n");
+
+    if (file != stdout)
+        fclose(file);
+
+    return regressed ? 2 : 0;
+}
@@ -0,0 +1,259 @@
+// Checks every algorithm in algorithms.hpp against its std equivalent. Sizes cover empty and single element input,
+// both sides of the sequential threshold and inputs spanning many blocks, on a pool with workers and on one
+// without. Returns non-zero on failure.
+
+#include <algorithms.hpp>
+
+#include <random>
+#include <stdio.h>
+#include <string>
+
+struct Record
+{
+    uint32_t    key;
+    uint32_t    index;
+    std::string name;
+};
+
+// 2x2 matrix product wrapping at 2^32: associative, but not commutative.
+struct Matrix
+{
+    uint32_t m[4];
+
+    bool operator==(const Matrix& other) const
+    {
+        return m[0] == other.m[0] && m[1] == other.m[1] && m[2] == other.m[2] && m[3] == other.m[3];
+    }
+};
+
+static Matrix multiply(const Matrix& a, const Matrix& b)
+{
+    Matrix result = { { a.m[0] * b.m[0] + a.m[1] * b.m[2], a.m[0] * b.m[1] + a.m[1] * b.m[3],
+                        a.m[2] * b.m[0] + a.m[3] * b.m[2], a.m[2] * b.m[1] + a.m[3] * b.m[3] } };
+    return result;
+}
+
+static bool g_ok = true;
+
+static void expect(bool condition, const char* pool_name, size_t count, const char* what)
+{
+    if (!condition)
+    {
+        printf("algorithms_test: %s, %u elements: %s\n", pool_name, unsigned(count), what);
+        g_ok = false;
+    }
+}
+
+template <typename Pool>
+static void check_sorts(Pool& pool, const char* name, size_t count, std::mt19937& rng)
+{
+    std::vector<uint32_t> input(count);
+
+    for (size_t i = 0; i < count; i++)
+        input[i] = uint32_t(rng() % (count + 1));
+
+    std::vector<uint32_t> result = input;
+    std::vector<uint32_t> expected = input;
+
+    dw::algorithms::sort(pool, result.begin(), result.end());
+    std::sort(expected.begin(), expected.end());
+    expect(result == expected, name, count, "sort");
+
+    result = input;
+    dw::algorithms::sort(pool, result.begin(), result.end(), std::greater<uint32_t>());
+    std::sort(expected.begin(), expected.end(), std::greater<uint32_t>());
+    expect(result == expected, name, count, "sort with comparator");
+
+    result = input;
+    dw::algorithms::radix_sort(pool, result.begin(), result.end());
+    std::sort(expected.begin(), expected.end());
+    expect(result == expected, name, count, "radix_sort uint32_t");
+
+    // Signed 64 bit keys spread over the whole range, so every pass and the sign flip matter.
+    std::vector<int64_t> wide(count);
+
+    for (size_t i = 0; i < count; i++)
+        wide[i] = int64_t((uint64_t(rng()) << 32) | rng());
+
+    std::vector<int64_t> wide_expected = wide;
+
+    dw::algorithms::radix_sort(pool, wide.begin(), wide.end());
+    std::sort(wide_expected.begin(), wide_expected.end());
+    expect(wide == wide_expected, name, count, "radix_sort int64_t");
+
+    std::vector<int8_t> narrow(count);
+
+    for (size_t i = 0; i < count; i++)
+        narrow[i] = int8_t(rng());
+
+    std::vector<int8_t> narrow_expected = narrow;
+
+    dw::algorithms::radix_sort(pool, narrow.begin(), narrow.end());
+    std::sort(narrow_expected.begin(), narrow_expected.end());
+    expect(narrow == narrow_expected, name, count, "radix_sort int8_t");
+
+    // Few distinct keys with a std::string payload: radix_sort has to be stable and move the strings intact.
+    std::vector<Record> records(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        records[i].key = rng() % 37;
+        records[i].index = uint32_t(i);
+        records[i].name = std::to_string(rng());
+    }
+
+    std::vector<Record> records_expected = records;
+
+    dw::algorithms::radix_sort(pool, records.begin(), records.end(), [](const Record& r) { return r.key; });
+    std::stable_sort(records_expected.begin(), records_expected.end(), [](const Record& a, const Record& b) { return a.key < b.key; });
+
+    bool same = true;
+
+    for (size_t i = 0; i < count; i++)
+        same = same && records[i].index == records_expected[i].index && records[i].name == records_expected[i].name;
+
+    expect(same, name, count, "radix_sort by key with std::string payload");
+
+    std::vector<std::string> strings(count);
+
+    for (size_t i = 0; i < count; i++)
+        strings[i] = std::to_string(rng() % (count + 1));
+
+    std::vector<std::string> strings_expected = strings;
+
+    dw::algorithms::sort(pool, strings.begin(), strings.end());
+    std::sort(strings_expected.begin(), strings_expected.end());
+    expect(strings == strings_expected, name, count, "sort std::string");
+}
+
+template <typename Pool>
+static void check_scans(Pool& pool, const char* name, size_t count, std::mt19937& rng)
+{
+    std::vector<uint64_t> input(count);
+
+    for (size_t i = 0; i < count; i++)
+        input[i] = rng() % 100;
+
+    std::vector<uint64_t> result(count);
+    std::vector<uint64_t> expected(count);
+
+    std::vector<uint64_t>::iterator end = dw::algorithms::inclusive_scan(pool, input.begin(), input.end(), result.begin());
+    std::partial_sum(input.begin(), input.end(), expected.begin());
+    expect(result == expected && end == result.end(), name, count, "inclusive_scan");
+
+    uint64_t sum = 5;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        expected[i] = sum;
+        sum += input[i];
+    }
+
+    end = dw::algorithms::exclusive_scan(pool, input.begin(), input.end(), result.begin(), uint64_t(5));
+    expect(result == expected && end == result.end(), name, count, "exclusive_scan");
+
+    result = input;
+    dw::algorithms::exclusive_scan(pool, result.begin(), result.end(), result.begin(), uint64_t(5));
+    expect(result == expected, name, count, "exclusive_scan in place");
+
+    // Non-commutative operator: every block has to see the prefix of the blocks before it, in order.
+    std::vector<Matrix> matrices(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        Matrix m = { { uint32_t(rng()), uint32_t(rng()), uint32_t(rng()), uint32_t(rng()) } };
+        matrices[i] = m;
+    }
+
+    std::vector<Matrix> products(count);
+    std::vector<Matrix> products_expected(count);
+
+    dw::algorithms::inclusive_scan(pool, matrices.begin(), matrices.end(), products.begin(), multiply);
+    std::partial_sum(matrices.begin(), matrices.end(), products_expected.begin(), multiply);
+    expect(products == products_expected, name, count, "inclusive_scan non-commutative");
+
+    // Associative but not commutative: the result is only right if blocks are folded in order.
+    const Matrix identity = { { 1, 0, 0, 1 } };
+    Matrix       product = identity;
+
+    for (size_t i = 0; i < count; i++)
+        product = multiply(product, matrices[i]);
+
+    expect(dw::algorithms::transform_reduce(pool, matrices.begin(), matrices.end(), identity, multiply, [](const Matrix& m) { return m; }) == product,
+           name, count, "transform_reduce non-commutative");
+
+    const uint64_t doubled = dw::algorithms::transform_reduce(pool, input.begin(), input.end(), uint64_t(7), std::plus<uint64_t>(),
+                                                              [](uint64_t value) { return value * 2; });
+    expect(doubled == 7 + 2 * std::accumulate(input.begin(), input.end(), uint64_t(0)), name, count, "transform_reduce");
+}
+
+template <typename Pool>
+static void check_partitions(Pool& pool, const char* name, size_t count, std::mt19937& rng)
+{
+    std::vector<uint32_t> input(count);
+
+    for (size_t i = 0; i < count; i++)
+        input[i] = rng();
+
+    std::vector<uint32_t> result(count);
+    std::vector<uint32_t> expected;
+
+    std::vector<uint32_t>::iterator end = dw::algorithms::copy_if(pool, input.begin(), input.end(), result.begin(),
+                                                                  [](uint32_t value) { return value % 3 == 0; });
+    std::copy_if(input.begin(), input.end(), std::back_inserter(expected), [](uint32_t value) { return value % 3 == 0; });
+    expect(size_t(end - result.begin()) == expected.size() && std::equal(expected.begin(), expected.end(), result.begin()), name, count,
+           "copy_if");
+
+    std::vector<uint32_t> odd(count);
+    std::vector<uint32_t> even(count);
+    std::vector<uint32_t> odd_expected;
+    std::vector<uint32_t> even_expected;
+
+    std::pair<std::vector<uint32_t>::iterator, std::vector<uint32_t>::iterator> ends =
+        dw::algorithms::partition_copy(pool, input.begin(), input.end(), odd.begin(), even.begin(), [](uint32_t value) { return (value & 1) != 0; });
+    std::partition_copy(input.begin(), input.end(), std::back_inserter(odd_expected), std::back_inserter(even_expected),
+                        [](uint32_t value) { return (value & 1) != 0; });
+    expect(size_t(ends.first - odd.begin()) == odd_expected.size() && size_t(ends.second - even.begin()) == even_expected.size() &&
+               std::equal(odd_expected.begin(), odd_expected.end(), odd.begin()) && std::equal(even_expected.begin(), even_expected.end(), even.begin()),
+           name, count, "partition_copy");
+
+    std::vector<std::string> strings(count);
+
+    for (size_t i = 0; i < count; i++)
+        strings[i] = std::to_string(rng() % 1000);
+
+    std::vector<std::string> strings_expected = strings;
+
+    std::vector<std::string>::iterator middle = dw::algorithms::stable_partition(pool, strings.begin(), strings.end(),
+                                                                                 [](const std::string& s) { return s.size() < 3; });
+    std::vector<std::string>::iterator middle_expected =
+        std::stable_partition(strings_expected.begin(), strings_expected.end(), [](const std::string& s) { return s.size() < 3; });
+    expect(middle - strings.begin() == middle_expected - strings_expected.begin() && strings == strings_expected, name, count, "stable_partition");
+}
+
+template <typename Pool>
+static void check_all(Pool& pool, const char* name, std::mt19937& rng)
+{
+    // Empty, single element, around the sequential threshold and block size for 4 byte elements, then many blocks.
+    const size_t counts[] = { 0, 1, 4095, 4096, 4097, 100000, 333333 };
+
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+    {
+        check_sorts(pool, name, counts[i], rng);
+        check_scans(pool, name, counts[i], rng);
+        check_partitions(pool, name, counts[i], rng);
+    }
+}
+
+int main()
+{
+    std::mt19937   rng(42);
+    dw::ThreadPool thread_pool(4);
+    dw::ThreadPool inline_pool(0);
+
+    check_all(thread_pool, "4 workers", rng);
+    check_all(inline_pool, "no workers", rng);
+
+    printf("algorithms_test: %s\n", g_ok ? "ok" : "failed");
+    return g_ok ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+// The frame arena's use-after-reset check. The abort has to take the process down, so the test runs itself twice
+// as a child: once with a payload task that runs before reset_frame_arena(), which has to exit cleanly, and once
+// with one that is only enqueued after it, which has to die. Checks are forced on, whatever NDEBUG says. Returns
+// non-zero on failure.
+
+#define THREAD_POOL_ARENA_CHECKS 1
+
+#include <thread_pool.hpp>
+
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+// Bigger than the task data, which is what payload tasks are for.
+#define PAYLOAD_SIZE 1024
+
+static std::atomic<bool> g_payload_ran(false);
+
+// Doesn't read the poisoned payload, so only the arena check can stop a stale task.
+static void payload_task(void* payload)
+{
+    (void)payload;
+    g_payload_ran.store(true);
+}
+
+static int run_child(bool reset_first)
+{
+    dw::ThreadPool thread_pool(1);
+    dw::Task*      task = thread_pool.allocate(&payload_task, PAYLOAD_SIZE);
+
+    if (!task)
+        return 1;
+
+    memset(thread_pool.payload(task), 0, PAYLOAD_SIZE);
+
+    if (reset_first)
+        thread_pool.reset_frame_arena();
+
+    thread_pool.enqueue(task);
+    thread_pool.wait_for_all();
+
+    return g_payload_ran.load() ? 0 : 1;
+}
+
+static int run_self(const char* self, const char* mode)
+{
+    const std::string command = std::string("\"") + self + "\" " + mode;
+    return system(command.c_str());
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        return run_child(strcmp(argv[1], "stale") == 0);
+
+    bool ok = true;
+
+    if (run_self(argv[0], "valid") != 0)
+    {
+        printf("arena_check_test: payload task running before reset_frame_arena() failed\n");
+        ok = false;
+    }
+
+    // The child's abort message on stderr is expected.
+    if (run_self(argv[0], "stale") == 0)
+    {
+        printf("arena_check_test: payload task running after reset_frame_arena() wasn't caught\n");
+        ok = false;
+    }
+
+    printf("arena_check_test: %s\n", ok ? "ok" : "failed");
+    return ok ? 0 : 1;
+}
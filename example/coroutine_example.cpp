@@ -0,0 +1,88 @@
+// Exercises the C++ 20 coroutine layer: pool-allocated frames, co_await pool.schedule(), awaiting named and temporary
+// tasks, when_all and sync_wait. Returns non-zero if a result comes out wrong. Built without coroutine support it only
+// reports that it was skipped.
+
+#include <coroutine.hpp>
+
+#include <stdio.h>
+
+#if DW_HAS_COROUTINES
+
+#include <numeric>
+#include <vector>
+
+#define NUM_CHUNKS 64
+#define CHUNK_SIZE 4096
+
+// First parameter is the pool, so the frame comes from the pool's frame arena.
+dw::task<uint64_t> sum_chunk(dw::ThreadPool& pool, uint32_t chunk)
+{
+    co_await pool.schedule();
+
+    uint64_t sum = 0;
+
+    for (uint32_t i = 0; i < CHUNK_SIZE; i++)
+        sum += uint64_t(chunk) * CHUNK_SIZE + i;
+
+    co_return sum;
+}
+
+dw::task<void> touch(dw::ThreadPool& pool, std::atomic<uint32_t>& count)
+{
+    co_await pool.schedule();
+    count.fetch_add(1, std::memory_order_relaxed);
+}
+
+dw::task<uint64_t> frame(dw::ThreadPool& pool, std::atomic<uint32_t>& count)
+{
+    std::vector<dw::task<uint64_t>> chunks;
+
+    for (uint32_t i = 0; i < NUM_CHUNKS; i++)
+        chunks.push_back(sum_chunk(pool, i));
+
+    std::vector<uint64_t> sums = co_await dw::when_all(std::move(chunks));
+
+    // A named task can be awaited more than once, the result stays in it. A wrong answer shows up in the total.
+    dw::task<uint64_t> first = sum_chunk(pool, 0);
+    const uint64_t     first_sum = co_await first;
+
+    if (co_await first != first_sum || first_sum != sums[0])
+        co_return 0;
+
+    std::vector<dw::task<void>> touches;
+
+    for (uint32_t i = 0; i < NUM_CHUNKS; i++)
+        touches.push_back(touch(pool, count));
+
+    co_await dw::when_all(std::move(touches));
+
+    co_return std::accumulate(sums.begin(), sums.end(), uint64_t(0));
+}
+
+int main()
+{
+    dw::ThreadPool        thread_pool(4);
+    std::atomic<uint32_t> count(0);
+
+    const uint64_t n = uint64_t(NUM_CHUNKS) * CHUNK_SIZE;
+    const uint64_t total = dw::sync_wait(thread_pool, frame(thread_pool, count));
+
+    if (total != n * (n - 1) / 2 || count.load() != NUM_CHUNKS)
+    {
+        printf("coroutine_example: wrong result (sum %llu, %u tasks)\n", (unsigned long long)total, count.load());
+        return 1;
+    }
+
+    printf("coroutine_example: ok\n");
+    return 0;
+}
+
+#else
+
+int main()
+{
+    printf("coroutine_example: skipped, no C++ 20 coroutine support\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,99 @@
+// Priorities with a saturated pool. The single worker is held on a gate task while normal, critical and background
+// tasks queue up behind it, in that order. Once released, critical tasks have to run first, and background tasks
+// have to get through by aging before the normal backlog is gone. Returns non-zero on failure.
+
+#include <thread_pool.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+
+#define NUM_NORMAL_TASKS 400
+#define NUM_CRITICAL_TASKS 32
+#define NUM_BACKGROUND_TASKS 4
+#define NUM_QUEUED_TASKS (NUM_NORMAL_TASKS + NUM_CRITICAL_TASKS + NUM_BACKGROUND_TASKS)
+
+// Every PRIORITY_AGING_INTERVAL-th pick starts below critical, so a few other tasks may slip in between.
+#define MAX_CRITICAL_POSITION (NUM_CRITICAL_TASKS + NUM_CRITICAL_TASKS / (dw::detail::PRIORITY_AGING_INTERVAL - 1) + 2)
+
+struct Log
+{
+    std::atomic<uint32_t> next_position;
+    uint32_t              positions[NUM_QUEUED_TASKS];
+};
+
+static void submit_logged(dw::ThreadPool& thread_pool, Log* log, uint32_t index, dw::TaskPriority priority)
+{
+    thread_pool.submit([log, index]() { log->positions[index] = log->next_position.fetch_add(1, std::memory_order_relaxed); }, priority);
+}
+
+int main()
+{
+    dw::ThreadPool    thread_pool(1);
+    Log               log;
+    std::atomic<bool> gate_started(false);
+    std::atomic<bool> gate_open(false);
+    bool              ok = true;
+
+    log.next_position = 0;
+
+    thread_pool.submit([&gate_started, &gate_open]() {
+        gate_started.store(true);
+
+        while (!gate_open.load())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    });
+
+    while (!gate_started.load())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // Queued oldest to newest: normal, critical, background. Plain FIFO would run critical work after all the normal.
+    uint32_t index = 0;
+
+    for (uint32_t i = 0; i < NUM_NORMAL_TASKS; i++)
+        submit_logged(thread_pool, &log, index++, dw::TaskPriority::NORMAL);
+
+    for (uint32_t i = 0; i < NUM_CRITICAL_TASKS; i++)
+        submit_logged(thread_pool, &log, index++, dw::TaskPriority::CRITICAL);
+
+    for (uint32_t i = 0; i < NUM_BACKGROUND_TASKS; i++)
+        submit_logged(thread_pool, &log, index++, dw::TaskPriority::BACKGROUND);
+
+    // Changing the order while the worker runs is allowed.
+    thread_pool.set_queue_order(dw::TaskPriority::NORMAL, dw::QueueOrder::FIFO);
+
+    gate_open.store(true);
+
+    // Poll instead of wait_for_all(), which would help and put a second consumer into the order.
+    while (log.next_position.load() < NUM_QUEUED_TASKS)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    thread_pool.wait_for_all();
+
+    uint32_t last_critical = 0;
+    uint32_t last_normal = 0;
+    uint32_t last_background = 0;
+
+    for (uint32_t i = 0; i < NUM_QUEUED_TASKS; i++)
+    {
+        uint32_t& last = i < NUM_NORMAL_TASKS ? last_normal : i < NUM_NORMAL_TASKS + NUM_CRITICAL_TASKS ? last_critical : last_background;
+        last = std::max(last, log.positions[i]);
+    }
+
+    if (last_critical >= MAX_CRITICAL_POSITION)
+    {
+        printf("priority_test: last critical task ran at position %u, expected below %u\n", last_critical, MAX_CRITICAL_POSITION);
+        ok = false;
+    }
+
+    if (last_background >= last_normal)
+    {
+        printf("priority_test: background tasks only got through after the normal backlog (%u >= %u)\n", last_background, last_normal);
+        ok = false;
+    }
+
+    printf("priority_test: %s\n", ok ? "ok" : "failed");
+    return ok ? 0 : 1;
+}
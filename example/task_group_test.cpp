@@ -0,0 +1,226 @@
+// Cancellation through task groups. The single worker is kept busy while group tasks, a future, and a task with a
+// continuation and a dependent queue up behind it; after cancel() none of them may run, the running task has to see
+// its token flip, every wait has to return and the future has to report is_cancelled(). Then the same with
+// expire_after() instead of cancel(), and a reset() group that runs everything again. Futures get their own round:
+// then() chains through Future<void>, and results of futures dropped before or after their task ran have to be
+// destroyed exactly once. Returns non-zero on failure.
+
+#include <thread_pool.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include <thread>
+
+#define NUM_QUEUED_TASKS 100
+#define EXPIRE_MS 10
+// A task waiting on its token gives up after this, so a broken token fails the test instead of hanging it.
+#define TOKEN_TIMEOUT_MS 5000
+
+static bool expect(const char* what, bool condition)
+{
+    if (!condition)
+        printf("task_group_test: %s\n", what);
+
+    return condition;
+}
+
+static void wait_for_flag(const std::atomic<bool>& flag)
+{
+    while (!flag.load())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+static bool test_cancel(dw::ThreadPool& thread_pool)
+{
+    dw::TaskGroup         group;
+    std::atomic<bool>     started(false);
+    std::atomic<bool>     saw_cancel(false);
+    std::atomic<uint32_t> num_ran(0);
+    std::atomic<bool>     continuation_ran(false);
+    std::atomic<bool>     dependent_ran(false);
+    bool                  ok = true;
+
+    // Occupies the worker until it notices the cancellation.
+    dw::CancellationToken token = group.token();
+
+    thread_pool.submit(group, [token, &started, &saw_cancel]() {
+        const std::chrono::steady_clock::time_point give_up = std::chrono::steady_clock::now() + std::chrono::milliseconds(TOKEN_TIMEOUT_MS);
+
+        started.store(true);
+
+        while (!token.is_cancelled() && std::chrono::steady_clock::now() < give_up)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        saw_cancel.store(token.is_cancelled());
+    });
+
+    wait_for_flag(started);
+
+    for (uint32_t i = 0; i < NUM_QUEUED_TASKS; i++)
+        thread_pool.submit(group, [&num_ran]() { num_ran++; });
+
+    dw::Future<int> future = thread_pool.submit(group, [&num_ran]() {
+        num_ran++;
+        return 42;
+    });
+
+    // Only the parent is in the group, its continuation and dependent get skipped along with it.
+    dw::Task* parent = thread_pool.allocate([&num_ran]() { num_ran++; });
+    dw::Task* continuation = thread_pool.allocate([&continuation_ran]() { continuation_ran.store(true); });
+    dw::Task* dependent = thread_pool.allocate([&dependent_ran]() { dependent_ran.store(true); });
+
+    thread_pool.set_group(parent, group);
+    ok = expect("define_continuation failed", thread_pool.define_continuation(parent, continuation)) && ok;
+    ok = expect("define_dependency failed", thread_pool.define_dependency(dependent, parent)) && ok;
+    thread_pool.enqueue(dependent);
+    thread_pool.enqueue(parent);
+
+    group.cancel();
+    thread_pool.wait_for_group(group);
+
+    ok = expect("wait_for_group returned with tasks pending", group.is_done()) && ok;
+    ok = expect("running task didn't see its token cancelled", saw_cancel.load()) && ok;
+    ok = expect("future isn't cancelled", future.is_ready() && future.is_cancelled()) && ok;
+
+    // The continuation and the dependent aren't in the group, wait for them separately.
+    thread_pool.wait_for_all();
+
+    ok = expect("skipped group tasks ran", num_ran.load() == 0) && ok;
+    ok = expect("continuation of a skipped task ran", !continuation_ran.load()) && ok;
+    ok = expect("dependent of a skipped task ran", !dependent_ran.load()) && ok;
+
+    return ok;
+}
+
+static bool test_expire(dw::ThreadPool& thread_pool)
+{
+    dw::TaskGroup         group;
+    std::atomic<bool>     started(false);
+    std::atomic<bool>     gate_open(false);
+    std::atomic<uint32_t> num_ran(0);
+    bool                  ok = true;
+
+    thread_pool.submit([&started, &gate_open]() {
+        started.store(true);
+        wait_for_flag(gate_open);
+    });
+
+    wait_for_flag(started);
+
+    for (uint32_t i = 0; i < NUM_QUEUED_TASKS; i++)
+        thread_pool.submit(group, [&num_ran]() { num_ran++; });
+
+    // Nothing can start before the deadline, the worker is held until well after it.
+    group.expire_after(std::chrono::milliseconds(EXPIRE_MS));
+    std::this_thread::sleep_for(std::chrono::milliseconds(EXPIRE_MS * 3));
+    gate_open.store(true);
+
+    thread_pool.wait_for_group(group);
+
+    ok = expect("expired group isn't cancelled", group.is_cancelled()) && ok;
+    ok = expect("expired tasks ran", num_ran.load() == 0) && ok;
+
+    // The gate isn't part of the group and may still be looking at gate_open.
+    thread_pool.wait_for_all();
+
+    // After reset() the group is live again.
+    group.reset();
+
+    for (uint32_t i = 0; i < NUM_QUEUED_TASKS; i++)
+        thread_pool.submit(group, [&num_ran]() { num_ran++; });
+
+    dw::Future<int> future = thread_pool.submit(group, []() { return 42; });
+
+    thread_pool.wait_for_group(group);
+
+    ok = expect("reset group still cancelled", !group.is_cancelled()) && ok;
+    ok = expect("tasks of a reset group didn't run", num_ran.load() == NUM_QUEUED_TASKS) && ok;
+    ok = expect("future of a reset group has no result", !future.is_cancelled() && future.get() == 42) && ok;
+    ok = expect("default token is cancelled", !dw::CancellationToken().is_cancelled()) && ok;
+
+    return ok;
+}
+
+// Counts live instances, so a result that is leaked or destroyed twice shows up.
+struct Tracked
+{
+    static std::atomic<int> num_alive;
+
+    int value;
+
+    explicit Tracked(int v) : value(v) { num_alive++; }
+    Tracked(const Tracked& other) : value(other.value) { num_alive++; }
+    ~Tracked() { num_alive--; }
+};
+
+std::atomic<int> Tracked::num_alive(0);
+
+static bool test_futures(dw::ThreadPool& thread_pool)
+{
+    bool ok = true;
+
+    // Each link gets the previous result by reference, the Future<void> link passes nothing on.
+    std::atomic<int> side_effect(0);
+
+    dw::Future<int>         first = thread_pool.submit([]() { return 20; });
+    dw::Future<std::string> text = first.then([](int& value) { return value + 1; }).then([](int& value) { return std::to_string(value * 2); });
+    dw::Future<void>        done = text.then([&side_effect](std::string& value) { side_effect.store(value == "42" ? 1 : -1); });
+    dw::Future<int>         last = done.then([&side_effect]() { return side_effect.load() * 7; });
+
+    ok = expect("then() left the future valid", !first.valid() && !text.valid() && !done.valid()) && ok;
+    ok = expect("then() chain gave the wrong result", last.get() == 7) && ok;
+
+    // Future<void> straight from then(), waited on by itself.
+    dw::Future<void> void_future = thread_pool.submit([]() { return 1; }).then([&side_effect](int& value) { side_effect.store(value + 1); });
+    void_future.get();
+    ok = expect("Future<void> finished without running", void_future.is_ready() && !void_future.is_cancelled() && side_effect.load() == 2) && ok;
+
+    // Dropped while the task is still queued: the task still runs, and the result it leaves behind is destroyed.
+    std::atomic<bool> started(false);
+    std::atomic<bool> gate_open(false);
+    std::atomic<bool> dropped_ran(false);
+
+    thread_pool.submit([&started, &gate_open]() {
+        started.store(true);
+        wait_for_flag(gate_open);
+    });
+
+    wait_for_flag(started);
+
+    {
+        dw::Future<Tracked> dropped = thread_pool.submit([&dropped_ran]() {
+            dropped_ran.store(true);
+            return Tracked(1);
+        });
+    }
+
+    gate_open.store(true);
+
+    // Dropped after its task ran, without anybody reading the result.
+    {
+        dw::Future<Tracked> unread = thread_pool.submit([]() { return Tracked(2); });
+        ok = expect("unread future never finished", unread.wait_for(std::chrono::seconds(5))) && ok;
+    }
+
+    thread_pool.wait_for_all();
+
+    ok = expect("task of a dropped future didn't run", dropped_ran.load()) && ok;
+    ok = expect("future results leaked or destroyed twice", Tracked::num_alive.load() == 0) && ok;
+
+    return ok;
+}
+
+int main()
+{
+    dw::ThreadPool thread_pool(1);
+    bool           ok = true;
+
+    ok = test_cancel(thread_pool) && ok;
+    ok = test_expire(thread_pool) && ok;
+    ok = test_futures(thread_pool) && ok;
+
+    printf("task_group_test: %s\n", ok ? "ok" : "failed");
+    return ok ? 0 : 1;
+}
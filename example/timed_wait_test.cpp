@@ -0,0 +1,76 @@
+// Timed waits have to give up on time even while the queue is full of work they could help with. One worker is
+// blocked on a long gate task while plenty of short tasks are queued behind it; every timed wait must come back
+// false well before the queue drains, and must not run a queued task itself, not even the one it waits on.
+// Returns non-zero on failure.
+
+#include <thread_pool.hpp>
+
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+
+#define GATE_MS 1000
+#define NUM_QUEUED_TASKS 200
+#define QUEUED_TASK_MS 5
+#define LONG_TASK_MS 30
+#define TIMEOUT_MS 10
+// Timed waits don't help with tasks, this is scheduling noise only.
+#define MAX_OVERRUN_MS 200
+
+static bool check(const char* name, bool result, std::chrono::steady_clock::time_point start)
+{
+    const long long elapsed_ms = (long long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    if (result || elapsed_ms > TIMEOUT_MS + MAX_OVERRUN_MS)
+    {
+        printf("timed_wait_test: %s returned %s after %lld ms\n", name, result ? "true" : "false", elapsed_ms);
+        return false;
+    }
+
+    return true;
+}
+
+int main()
+{
+    dw::ThreadPool thread_pool(1);
+    dw::TaskGroup  group;
+    bool           ok = true;
+
+    dw::TaskHandle gate = thread_pool.submit([]() { std::this_thread::sleep_for(std::chrono::milliseconds(GATE_MS)); });
+
+    // Let the worker pick up the gate before anything else is queued.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    for (int i = 0; i < NUM_QUEUED_TASKS; i++)
+        thread_pool.submit(group, []() { std::this_thread::sleep_for(std::chrono::milliseconds(QUEUED_TASK_MS)); });
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ok = check("wait_for(handle)", thread_pool.wait_for(gate, std::chrono::milliseconds(TIMEOUT_MS)), start) && ok;
+
+    start = std::chrono::steady_clock::now();
+    ok = check("wait_until(handle)", thread_pool.wait_until(gate, start + std::chrono::milliseconds(TIMEOUT_MS)), start) && ok;
+
+    start = std::chrono::steady_clock::now();
+    ok = check("wait_for_all(timeout)", thread_pool.wait_for_all(std::chrono::milliseconds(TIMEOUT_MS)), start) && ok;
+
+    start = std::chrono::steady_clock::now();
+    ok = check("wait_for_group(timeout)", thread_pool.wait_for_group(group, std::chrono::milliseconds(TIMEOUT_MS)), start) && ok;
+
+    // Critical, so a waiter that helps would pick this one first, run it and come back true after LONG_TASK_MS.
+    dw::TaskHandle long_task = thread_pool.submit([]() { std::this_thread::sleep_for(std::chrono::milliseconds(LONG_TASK_MS)); }, dw::TaskPriority::CRITICAL);
+
+    start = std::chrono::steady_clock::now();
+    ok = check("wait_for(queued task)", thread_pool.wait_for(long_task, std::chrono::milliseconds(TIMEOUT_MS)), start) && ok;
+
+    // Untimed waits still see everything through.
+    thread_pool.wait_for_all();
+
+    if (!thread_pool.wait_for(gate, std::chrono::milliseconds(TIMEOUT_MS)) || !group.is_done())
+    {
+        printf("timed_wait_test: tasks still pending after wait_for_all()\n");
+        ok = false;
+    }
+
+    printf("timed_wait_test: %s\n", ok ? "ok" : "failed");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+// Builds and runs a pool with every non-default queue policy, wait policy and instrumentation setting, plus a smaller
+// task capacity and trace ring, so none of them can stop compiling unnoticed. Each pool goes through submission,
+// futures, groups, graphs, parallel loops and the parallel algorithms. Returns non-zero if a result comes out wrong.
+
+#include <thread_pool.hpp>
+#include <algorithms.hpp>
+
+#include <atomic>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#define NUM_TASKS 1000
+#define NUM_ELEMENTS 100000
+#define NUM_CHARACTERS 4000
+
+struct MutexTraits : dw::DefaultThreadPoolTraits
+{
+    static const dw::QueuePolicy QUEUE_POLICY = dw::QueuePolicy::MUTEX;
+};
+
+struct LockFreeTraits : dw::DefaultThreadPoolTraits
+{
+    static const dw::QueuePolicy QUEUE_POLICY = dw::QueuePolicy::LOCK_FREE;
+};
+
+struct SpinTraits : dw::DefaultThreadPoolTraits
+{
+    static const dw::WaitPolicy WAIT_POLICY = dw::WaitPolicy::SPIN;
+    static const uint32_t       MAX_TASKS = 4096;
+};
+
+struct SleepTraits : dw::DefaultThreadPoolTraits
+{
+    static const dw::WaitPolicy WAIT_POLICY = dw::WaitPolicy::SLEEP;
+};
+
+struct InstrumentedTraits : dw::DefaultThreadPoolTraits
+{
+    static const bool     STATS = true;
+    static const bool     TRACE = true;
+    static const uint32_t TRACE_BUFFER_SIZE = 1024;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool expect(const char* traits, const char* what, bool condition)
+{
+    if (!condition)
+        printf("traits_test: %s: %s failed\n", traits, what);
+
+    return condition;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+template <typename Traits>
+static bool run_checks(const char* traits)
+{
+    typedef dw::BasicThreadPool<Traits> Pool;
+
+    Pool                  pool(2);
+    std::atomic<uint32_t> count(0);
+    bool                  ok = true;
+
+    for (uint32_t i = 0; i < NUM_TASKS; i++)
+        pool.submit([&count]() { count.fetch_add(1, std::memory_order_relaxed); });
+
+    pool.wait_for_all();
+    ok = expect(traits, "submit", count.load() == NUM_TASKS) && ok;
+
+    dw::Future<int, Traits> future = pool.submit([]() { return 20; }).then([](int x) { return x + 22; });
+    ok = expect(traits, "future", future.get() == 42) && ok;
+
+    dw::TaskGroup group;
+    count = 0;
+
+    for (uint32_t i = 0; i < NUM_TASKS; i++)
+        pool.submit(group, [&count]() { count.fetch_add(1, std::memory_order_relaxed); });
+
+    pool.wait_for_group(group);
+    ok = expect(traits, "group", count.load() == NUM_TASKS) && ok;
+
+    // Each node checks that its predecessor already ran.
+    typename Pool::TaskGraph graph;
+    std::atomic<uint32_t>*   step = &count;
+    count = 0;
+
+    const uint32_t first = graph.add_node([step]() { uint32_t expected = 0; step->compare_exchange_strong(expected, 1u); });
+    const uint32_t second = graph.add_node([step]() { uint32_t expected = 1; step->compare_exchange_strong(expected, 2u); });
+    graph.precede(first, second);
+    graph.compile();
+
+    pool.run(graph);
+    pool.wait_for_graph(graph);
+    ok = expect(traits, "graph", count.load() == 2) && ok;
+
+    std::vector<uint32_t> values(NUM_ELEMENTS);
+
+    pool.parallel_for(0, NUM_ELEMENTS, 256, [&values](uint32_t i) { values[i] = NUM_ELEMENTS - i; });
+
+    const uint64_t sum = pool.parallel_reduce(0u, NUM_ELEMENTS, 1024u, uint64_t(0), [&values](uint32_t i) { return uint64_t(values[i]); }, [](uint64_t a, uint64_t b) { return a + b; });
+    ok = expect(traits, "parallel_reduce", sum == uint64_t(NUM_ELEMENTS) * (NUM_ELEMENTS + 1) / 2) && ok;
+
+    // Concatenation is associative but not commutative, a small grain makes sure the range gets split.
+    std::string expected_text;
+
+    for (uint32_t i = 0; i < NUM_CHARACTERS; i++)
+        expected_text += char('a' + i % 26);
+
+    const std::string text = pool.parallel_reduce(0u, NUM_CHARACTERS, 8u, std::string(), [](uint32_t i) { return std::string(1, char('a' + i % 26)); },
+                                                  [](const std::string& a, const std::string& b) { return a + b; });
+    ok = expect(traits, "parallel_reduce in order", text == expected_text) && ok;
+
+    dw::algorithms::sort(pool, values.begin(), values.end());
+    ok = expect(traits, "sort", std::is_sorted(values.begin(), values.end()) && values[0] == 1) && ok;
+
+    if (Traits::STATS)
+        ok = expect(traits, "stats", pool.stats().total.tasks_executed != 0) && ok;
+
+    if (Traits::TRACE)
+        ok = expect(traits, "dump_trace", pool.dump_trace("traits_test_trace.json")) && ok;
+
+    return ok;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+int main()
+{
+    bool ok = true;
+
+    ok = run_checks<MutexTraits>("QueuePolicy::MUTEX") && ok;
+    ok = run_checks<LockFreeTraits>("QueuePolicy::LOCK_FREE") && ok;
+    ok = run_checks<SpinTraits>("WaitPolicy::SPIN") && ok;
+    ok = run_checks<SleepTraits>("WaitPolicy::SLEEP") && ok;
+    ok = run_checks<InstrumentedTraits>("STATS and TRACE") && ok;
+
+    printf("traits_test: %s\n", ok ? "ok" : "failed");
+    return ok ? 0 : 1;
+}
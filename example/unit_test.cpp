@@ -113,6 +113,33 @@ void ecs_update(dw::ThreadPool& tp)
     tp.wait_for_all();
 }
 
+void build_ecs_graph(dw::TaskGraph& graph)
+{
+    uint32_t animation_pre_transform_update_node  = graph.add_node(AnimationPreTransformUpdateTask);
+    uint32_t transform_update_node                = graph.add_node(TransformUpdateTask);
+    uint32_t physics_sync_node                    = graph.add_node(PhysicsSyncTask);
+    uint32_t animation_post_transform_update_node = graph.add_node(AnimationPostTransformUpdateTask);
+    uint32_t audio_listener_update_node           = graph.add_node(AudioListenerUpdateTask);
+    uint32_t audio_source_update_node             = graph.add_node(AudioSourceUpdateTask);
+    uint32_t particle_update_node                 = graph.add_node(ParticleUpdateTask);
+    uint32_t script_update_node                   = graph.add_node(ScriptUpdateTask);
+
+    graph.precede(animation_pre_transform_update_node, transform_update_node);
+    graph.precede(animation_pre_transform_update_node, physics_sync_node);
+
+    graph.precede(transform_update_node, animation_post_transform_update_node);
+    graph.precede(transform_update_node, audio_listener_update_node);
+    graph.precede(transform_update_node, audio_source_update_node);
+    graph.precede(transform_update_node, particle_update_node);
+
+    graph.precede(animation_post_transform_update_node, script_update_node);
+    graph.precede(audio_listener_update_node, script_update_node);
+    graph.precede(audio_source_update_node, script_update_node);
+    graph.precede(particle_update_node, script_update_node);
+
+    graph.compile();
+}
+
 int main()
 {
 	Remotery* rmt;
@@ -123,6 +150,16 @@ int main()
     for (int i = 0; i < 4; i++)
         ecs_update(thread_pool);
 
+    // Same frame, but built once and relaunched every frame.
+    dw::TaskGraph ecs_graph;
+    build_ecs_graph(ecs_graph);
+
+    for (int i = 0; i < 2; i++)
+    {
+        thread_pool.run(ecs_graph);
+        thread_pool.wait_for_graph(ecs_graph);
+    }
+
     int a;
     std::cin >> a;
     
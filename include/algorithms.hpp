@@ -0,0 +1,615 @@
+#pragma once
+
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+// Parallel sort, scan, partition and reduce on top of any dw::BasicThreadPool. Work is cut into cache sized blocks
+// that go through parallel_for(), so the calling thread processes blocks as well and every call returns once the
+// result is complete. Element counts have to fit in uint32_t, iterators have to be random access.
+
+namespace dw
+{
+namespace algorithms
+{
+    namespace detail
+    {
+
+    // Bytes of input per block for the streaming passes (reduce, scan, compaction, merging).
+    constexpr uint32_t BLOCK_BYTES          = 16384u;
+    // Below this many elements everything runs on the calling thread.
+    constexpr uint32_t SEQUENTIAL_THRESHOLD = 4096u;
+    // Sort runs and radix blocks per thread, enough for lazy splitting to even out blocks of uneven cost.
+    constexpr uint32_t BLOCKS_PER_THREAD    = 4u;
+    constexpr uint32_t RADIX_BITS           = 8u;
+    constexpr uint32_t RADIX_BUCKETS        = 1u << RADIX_BITS;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    template <typename T>
+    inline uint32_t block_size()
+    {
+        return sizeof(T) < BLOCK_BYTES ? uint32_t(BLOCK_BYTES / sizeof(T)) : 1u;
+    }
+
+    inline uint32_t num_blocks(size_t count, size_t block)
+    {
+        return uint32_t((count + block - 1) / block);
+    }
+
+    // Workers plus the calling thread.
+    template <typename Pool>
+    inline uint32_t num_threads(Pool& pool)
+    {
+        return pool.num_worker_threads() + 1;
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    template <typename Pool, typename SrcIt, typename DstIt>
+    inline void move_range(Pool& pool, SrcIt src, DstIt dst, size_t count)
+    {
+        typedef typename std::iterator_traits<SrcIt>::value_type T;
+
+        const uint32_t block = block_size<T>();
+
+        pool.parallel_for(0, num_blocks(count, block), 1, [&](uint32_t b) {
+            const size_t begin = size_t(b) * block;
+            const size_t end = std::min(begin + block, count);
+
+            std::move(src + begin, src + end, dst + begin);
+        });
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Reduce-then-scan: block sums in parallel, a short sequential scan over the sums, then every block scans itself
+    // starting from its carry. Reads the input twice and writes it once, in place works too. init is required for
+    // exclusive scans.
+    template <typename Pool, typename InIt, typename OutIt, typename T, typename Op>
+    inline OutIt scan(Pool& pool, InIt first, InIt last, OutIt d_first, const T* init, Op op, bool exclusive)
+    {
+        const size_t   count = size_t(last - first);
+        const uint32_t block = block_size<typename std::iterator_traits<InIt>::value_type>();
+
+        if (count == 0)
+            return d_first;
+
+        const uint32_t num_scan_blocks = num_blocks(count, block);
+        std::vector<T> sums;
+
+        if (num_scan_blocks > 1)
+        {
+            sums.assign(num_scan_blocks - 1, T(*first));
+
+            // The last block's sum is never needed.
+            pool.parallel_for(0, num_scan_blocks - 1, 1, [&](uint32_t b) {
+                const size_t begin = size_t(b) * block;
+                T            sum(first[begin]);
+
+                for (size_t i = begin + 1; i < begin + block; i++)
+                    sum = op(sum, first[i]);
+
+                sums[b] = sum;
+            });
+
+            // Turn the sums into each block's carry-in, shifted by one: sums[b] becomes the carry of block b + 1.
+            for (uint32_t b = 0; b < num_scan_blocks - 1; b++)
+            {
+                if (b > 0)
+                    sums[b] = op(sums[b - 1], sums[b]);
+                else if (init)
+                    sums[b] = op(*init, sums[b]);
+            }
+        }
+
+        pool.parallel_for(0, num_scan_blocks, 1, [&](uint32_t b) {
+            const size_t begin = size_t(b) * block;
+            const size_t end = std::min(begin + block, count);
+            const T*     carry = b > 0 ? &sums[b - 1] : init;
+
+            if (exclusive)
+            {
+                T sum(*carry);
+
+                for (size_t i = begin; i < end; i++)
+                {
+                    T value(first[i]);
+                    d_first[i] = sum;
+                    sum = op(sum, value);
+                }
+            }
+            else
+            {
+                T sum(carry ? op(*carry, first[begin]) : T(first[begin]));
+                d_first[begin] = sum;
+
+                for (size_t i = begin + 1; i < end; i++)
+                {
+                    sum = op(sum, first[i]);
+                    d_first[i] = sum;
+                }
+            }
+        });
+
+        return d_first + count;
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Evaluates pred once per element into flags and returns how many elements of each block passed, as exclusive
+    // offsets (offsets[b] is where block b's first selected element goes, offsets.back() the total).
+    template <typename Pool, typename RandomIt, typename Pred>
+    inline void select(Pool& pool, RandomIt first, size_t count, uint32_t block, Pred& pred, std::vector<uint8_t>& flags, std::vector<size_t>& offsets)
+    {
+        const uint32_t num_select_blocks = num_blocks(count, block);
+
+        flags.resize(count);
+        offsets.assign(num_select_blocks + 1, 0);
+
+        pool.parallel_for(0, num_select_blocks, 1, [&](uint32_t b) {
+            const size_t begin = size_t(b) * block;
+            const size_t end = std::min(begin + block, count);
+            size_t       num_selected = 0;
+
+            for (size_t i = begin; i < end; i++)
+            {
+                flags[i] = pred(first[i]) ? 1 : 0;
+                num_selected += flags[i];
+            }
+
+            offsets[b + 1] = num_selected;
+        });
+
+        for (uint32_t b = 0; b < num_select_blocks; b++)
+            offsets[b + 1] += offsets[b];
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    template <typename Dst, typename Src>
+    inline void transfer(Dst&& dst, Src&& src, std::false_type)
+    {
+        dst = src;
+    }
+
+    template <typename Dst, typename Src>
+    inline void transfer(Dst&& dst, Src&& src, std::true_type)
+    {
+        dst = std::move(src);
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Second half of a stable partition after select(): selected elements go to d_true, the rest to d_false, both
+    // in their original order. Copies, or moves if Move is std::true_type.
+    template <typename Move, typename Pool, typename RandomIt, typename TrueIt, typename FalseIt>
+    inline void scatter(Pool& pool, RandomIt first, size_t count, uint32_t block, const std::vector<uint8_t>& flags, const std::vector<size_t>& offsets, TrueIt d_true, FalseIt d_false)
+    {
+        pool.parallel_for(0, num_blocks(count, block), 1, [&](uint32_t b) {
+            const size_t begin = size_t(b) * block;
+            const size_t end = std::min(begin + block, count);
+            size_t       true_index = offsets[b];
+            size_t       false_index = begin - offsets[b];
+
+            for (size_t i = begin; i < end; i++)
+            {
+                if (flags[i])
+                    transfer(d_true[true_index++], first[i], Move());
+                else
+                    transfer(d_false[false_index++], first[i], Move());
+            }
+        });
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // How many of the first diagonal elements of merge(a, b) come from a. Ties go to a, like std::merge.
+    template <typename It, typename Compare>
+    inline size_t merge_path(It a, size_t size_a, It b, size_t size_b, size_t diagonal, Compare& comp)
+    {
+        size_t low = diagonal > size_b ? diagonal - size_b : 0;
+        size_t high = std::min(diagonal, size_a);
+
+        while (low < high)
+        {
+            const size_t middle = low + (high - low) / 2;
+
+            // a[middle] is taken before b[diagonal - middle - 1], so the split lies further along a.
+            if (!comp(b[diagonal - middle - 1], a[middle]))
+                low = middle + 1;
+            else
+                high = middle;
+        }
+
+        return low;
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Merges neighbouring runs of width elements from src into dst. The output of every pair is cut into blocks that
+    // each find their inputs with a binary search, so even the last pass, with a single pair, uses every thread. All
+    // splits are searched before any element is moved, a block would otherwise compare against moved-from neighbours.
+    template <typename Pool, typename SrcIt, typename DstIt, typename Compare>
+    inline void merge_pass(Pool& pool, SrcIt src, DstIt dst, size_t count, size_t width, Compare& comp, std::vector<size_t>& splits)
+    {
+        const uint32_t block = block_size<typename std::iterator_traits<SrcIt>::value_type>();
+        const size_t   pair_size = width * 2;
+        const uint32_t num_pairs = num_blocks(count, pair_size);
+        const uint32_t blocks_per_pair = num_blocks(std::min(pair_size, count), block);
+
+        splits.resize(size_t(num_pairs) * blocks_per_pair);
+
+        pool.parallel_for(0, num_pairs * blocks_per_pair, 1, [&](uint32_t index) {
+            const size_t low = size_t(index / blocks_per_pair) * pair_size;
+            const size_t middle = std::min(low + width, count);
+            const size_t high = std::min(low + pair_size, count);
+            const size_t begin = std::min(low + size_t(index % blocks_per_pair) * block, high);
+
+            splits[index] = merge_path(src + low, middle - low, src + middle, high - middle, begin - low, comp);
+        });
+
+        pool.parallel_for(0, num_pairs * blocks_per_pair, 1, [&](uint32_t index) {
+            const size_t low = size_t(index / blocks_per_pair) * pair_size;
+            const size_t middle = std::min(low + width, count);
+            const size_t high = std::min(low + pair_size, count);
+            const size_t begin = low + size_t(index % blocks_per_pair) * block;
+
+            // Pairs at the end are shorter.
+            if (begin >= high)
+                return;
+
+            const size_t end = std::min(begin + block, high);
+            const size_t a_begin = splits[index];
+            const size_t a_end = index % blocks_per_pair + 1 < blocks_per_pair ? splits[index + 1] : middle - low;
+
+            std::merge(std::make_move_iterator(src + low + a_begin), std::make_move_iterator(src + low + a_end),
+                       std::make_move_iterator(src + middle + (begin - low - a_begin)), std::make_move_iterator(src + middle + (end - low - a_end)),
+                       dst + begin, comp);
+        });
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // One stable counting pass over RADIX_BITS bits of the key. Returns false without touching dst if every key has
+    // the same digit, the pass would only copy then.
+    template <typename Pool, typename SrcIt, typename DstIt, typename Key>
+    inline bool radix_pass(Pool& pool, SrcIt src, DstIt dst, size_t count, size_t block, uint32_t shift, Key& key, std::vector<size_t>& histograms)
+    {
+        const uint32_t num_radix_blocks = num_blocks(count, block);
+
+        pool.parallel_for(0, num_radix_blocks, 1, [&](uint32_t b) {
+            const size_t begin = size_t(b) * block;
+            const size_t end = std::min(begin + block, count);
+            size_t*      histogram = &histograms[size_t(b) * RADIX_BUCKETS];
+
+            std::fill(histogram, histogram + RADIX_BUCKETS, size_t(0));
+
+            for (size_t i = begin; i < end; i++)
+                histogram[uint32_t(key(src[i]) >> shift) & (RADIX_BUCKETS - 1)]++;
+        });
+
+        // Totals over all blocks come first, the skip check needs them before the histograms turn into offsets.
+        for (uint32_t digit = 0; digit < RADIX_BUCKETS; digit++)
+        {
+            size_t num_digit = 0;
+
+            for (uint32_t b = 0; b < num_radix_blocks; b++)
+                num_digit += histograms[size_t(b) * RADIX_BUCKETS + digit];
+
+            if (num_digit == count)
+                return false;
+
+            if (num_digit != 0)
+                break;
+        }
+
+        // Bucket major, block minor: every block scatters into its own slice of each bucket, which keeps it stable.
+        size_t offset = 0;
+
+        for (uint32_t digit = 0; digit < RADIX_BUCKETS; digit++)
+        {
+            for (uint32_t b = 0; b < num_radix_blocks; b++)
+            {
+                const size_t num_digit = histograms[size_t(b) * RADIX_BUCKETS + digit];
+
+                histograms[size_t(b) * RADIX_BUCKETS + digit] = offset;
+                offset += num_digit;
+            }
+        }
+
+        pool.parallel_for(0, num_radix_blocks, 1, [&](uint32_t b) {
+            const size_t begin = size_t(b) * block;
+            const size_t end = std::min(begin + block, count);
+            size_t*      offsets = &histograms[size_t(b) * RADIX_BUCKETS];
+
+            for (size_t i = begin; i < end; i++)
+                dst[offsets[uint32_t(key(src[i]) >> shift) & (RADIX_BUCKETS - 1)]++] = std::move(src[i]);
+        });
+
+        return true;
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Default radix_sort() key: integers map to an unsigned key with the same order.
+    template <typename T>
+    struct RadixKey
+    {
+        static_assert(std::is_integral<T>::value, "radix_sort() without a key needs integer elements");
+
+        typedef typename std::make_unsigned<T>::type Key;
+
+        inline Key operator()(const T& value) const
+        {
+            return std::is_signed<T>::value ? Key(Key(value) ^ (Key(1) << (sizeof(T) * 8 - 1))) : Key(value);
+        }
+    };
+
+    } // namespace detail
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Folds transform(x) for every element into init with reduce. Block results are combined in order, so reduce
+    // only has to be associative.
+    template <typename Pool, typename RandomIt, typename T, typename Reduce, typename Transform>
+    inline T transform_reduce(Pool& pool, RandomIt first, RandomIt last, T init, Reduce reduce, Transform transform)
+    {
+        const size_t   count = size_t(last - first);
+        const uint32_t block = detail::block_size<typename std::iterator_traits<RandomIt>::value_type>();
+
+        if (count < detail::SEQUENTIAL_THRESHOLD)
+        {
+            for (; first != last; ++first)
+                init = reduce(init, transform(*first));
+
+            return init;
+        }
+
+        const uint32_t num_reduce_blocks = detail::num_blocks(count, block);
+        std::vector<T> partials(num_reduce_blocks, init);
+
+        pool.parallel_for(0, num_reduce_blocks, 1, [&](uint32_t b) {
+            const size_t begin = size_t(b) * block;
+            const size_t end = std::min(begin + block, count);
+            T            partial(transform(first[begin]));
+
+            for (size_t i = begin + 1; i < end; i++)
+                partial = reduce(partial, transform(first[i]));
+
+            partials[b] = partial;
+        });
+
+        for (uint32_t b = 0; b < num_reduce_blocks; b++)
+            init = reduce(init, partials[b]);
+
+        return init;
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // d_first[i] = first[0] op ... op first[i]. op has to be associative. Returns the end of the output.
+    template <typename Pool, typename RandomIt, typename OutIt, typename Op>
+    inline OutIt inclusive_scan(Pool& pool, RandomIt first, RandomIt last, OutIt d_first, Op op)
+    {
+        typedef typename std::iterator_traits<RandomIt>::value_type T;
+
+        if (size_t(last - first) < detail::SEQUENTIAL_THRESHOLD)
+            return std::partial_sum(first, last, d_first, op);
+
+        return detail::scan<Pool, RandomIt, OutIt, T, Op>(pool, first, last, d_first, nullptr, op, false);
+    }
+
+    template <typename Pool, typename RandomIt, typename OutIt>
+    inline OutIt inclusive_scan(Pool& pool, RandomIt first, RandomIt last, OutIt d_first)
+    {
+        return inclusive_scan(pool, first, last, d_first, std::plus<typename std::iterator_traits<RandomIt>::value_type>());
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // d_first[i] = init op first[0] op ... op first[i - 1], so d_first[0] = init. op has to be associative.
+    template <typename Pool, typename RandomIt, typename OutIt, typename T, typename Op>
+    inline OutIt exclusive_scan(Pool& pool, RandomIt first, RandomIt last, OutIt d_first, T init, Op op)
+    {
+        if (size_t(last - first) < detail::SEQUENTIAL_THRESHOLD)
+        {
+            for (; first != last; ++first, ++d_first)
+            {
+                T value(*first);
+                *d_first = init;
+                init = op(init, value);
+            }
+
+            return d_first;
+        }
+
+        return detail::scan(pool, first, last, d_first, &init, op, true);
+    }
+
+    template <typename Pool, typename RandomIt, typename OutIt, typename T>
+    inline OutIt exclusive_scan(Pool& pool, RandomIt first, RandomIt last, OutIt d_first, T init)
+    {
+        return exclusive_scan(pool, first, last, d_first, init, std::plus<T>());
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Stream compaction: copies the elements pred accepts to d_first, keeping their order. pred runs once per
+    // element. Returns the end of the output.
+    template <typename Pool, typename RandomIt, typename OutIt, typename Pred>
+    inline OutIt copy_if(Pool& pool, RandomIt first, RandomIt last, OutIt d_first, Pred pred)
+    {
+        const size_t   count = size_t(last - first);
+        const uint32_t block = detail::block_size<typename std::iterator_traits<RandomIt>::value_type>();
+
+        if (count < detail::SEQUENTIAL_THRESHOLD)
+            return std::copy_if(first, last, d_first, pred);
+
+        std::vector<uint8_t> flags;
+        std::vector<size_t>  offsets;
+
+        detail::select(pool, first, count, block, pred, flags, offsets);
+
+        pool.parallel_for(0, detail::num_blocks(count, block), 1, [&](uint32_t b) {
+            const size_t begin = size_t(b) * block;
+            const size_t end = std::min(begin + block, count);
+            OutIt        out = d_first + offsets[b];
+
+            for (size_t i = begin; i < end; i++)
+            {
+                if (flags[i])
+                    *out++ = first[i];
+            }
+        });
+
+        return d_first + offsets.back();
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Copies the elements pred accepts to d_true and the rest to d_false, both in their original order. Returns the
+    // ends of both outputs.
+    template <typename Pool, typename RandomIt, typename TrueIt, typename FalseIt, typename Pred>
+    inline std::pair<TrueIt, FalseIt> partition_copy(Pool& pool, RandomIt first, RandomIt last, TrueIt d_true, FalseIt d_false, Pred pred)
+    {
+        const size_t count = size_t(last - first);
+
+        const uint32_t block = detail::block_size<typename std::iterator_traits<RandomIt>::value_type>();
+
+        if (count < detail::SEQUENTIAL_THRESHOLD)
+            return std::partition_copy(first, last, d_true, d_false, pred);
+
+        std::vector<uint8_t> flags;
+        std::vector<size_t>  offsets;
+
+        detail::select(pool, first, count, block, pred, flags, offsets);
+        detail::scatter<std::false_type>(pool, first, count, block, flags, offsets, d_true, d_false);
+
+        return std::make_pair(d_true + offsets.back(), d_false + (count - offsets.back()));
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Moves the elements pred accepts in front of the rest, keeping the relative order within both groups, and
+    // returns where the second group starts. Goes through a temporary buffer of default constructed elements.
+    template <typename Pool, typename RandomIt, typename Pred>
+    inline RandomIt stable_partition(Pool& pool, RandomIt first, RandomIt last, Pred pred)
+    {
+        typedef typename std::iterator_traits<RandomIt>::value_type T;
+
+        const size_t   count = size_t(last - first);
+        const uint32_t block = detail::block_size<T>();
+
+        if (count < detail::SEQUENTIAL_THRESHOLD)
+            return std::stable_partition(first, last, pred);
+
+        std::vector<uint8_t> flags;
+        std::vector<size_t>  offsets;
+        std::vector<T>       buffer(count);
+
+        detail::select(pool, first, count, block, pred, flags, offsets);
+        detail::scatter<std::true_type>(pool, first, count, block, flags, offsets, buffer.begin(), buffer.begin() + ptrdiff_t(offsets.back()));
+        detail::move_range(pool, buffer.begin(), first, count);
+
+        return first + ptrdiff_t(offsets.back());
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Parallel merge sort: the calling thread and the workers std::sort a few runs each, then runs are merged in
+    // pairs, every merge split across threads. Not stable. Needs a temporary buffer of default constructed elements.
+    template <typename Pool, typename RandomIt, typename Compare>
+    inline void sort(Pool& pool, RandomIt first, RandomIt last, Compare comp)
+    {
+        typedef typename std::iterator_traits<RandomIt>::value_type T;
+
+        const size_t   count = size_t(last - first);
+        const uint32_t num_runs = detail::num_threads(pool) * detail::BLOCKS_PER_THREAD;
+        const size_t   run = std::max(size_t(detail::SEQUENTIAL_THRESHOLD), (count + num_runs - 1) / num_runs);
+
+        if (count <= run)
+        {
+            std::sort(first, last, comp);
+            return;
+        }
+
+        pool.parallel_for(0, detail::num_blocks(count, run), 1, [&](uint32_t r) {
+            std::sort(first + size_t(r) * run, first + std::min(size_t(r + 1) * run, count), comp);
+        });
+
+        std::vector<T>      buffer(count);
+        std::vector<size_t> splits;
+        bool                in_buffer = false;
+
+        for (size_t width = run; width < count; width *= 2)
+        {
+            if (in_buffer)
+                detail::merge_pass(pool, buffer.begin(), first, count, width, comp, splits);
+            else
+                detail::merge_pass(pool, first, buffer.begin(), count, width, comp, splits);
+
+            in_buffer = !in_buffer;
+        }
+
+        if (in_buffer)
+            detail::move_range(pool, buffer.begin(), first, count);
+    }
+
+    template <typename Pool, typename RandomIt>
+    inline void sort(Pool& pool, RandomIt first, RandomIt last)
+    {
+        sort(pool, first, last, std::less<typename std::iterator_traits<RandomIt>::value_type>());
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Stable LSD radix sort by key(element), which has to return an unsigned integer. One pass per RADIX_BITS of the
+    // key; passes where every key has the same digit are skipped, so small keys in wide types cost less. Needs a
+    // temporary buffer of default constructed elements.
+    template <typename Pool, typename RandomIt, typename Key>
+    inline void radix_sort(Pool& pool, RandomIt first, RandomIt last, Key key)
+    {
+        typedef typename std::iterator_traits<RandomIt>::value_type T;
+        typedef typename std::decay<decltype(key(*first))>::type     KeyType;
+
+        static_assert(std::is_integral<KeyType>::value && std::is_unsigned<KeyType>::value, "radix_sort() keys have to be unsigned integers");
+
+        const size_t count = size_t(last - first);
+
+        if (count < detail::SEQUENTIAL_THRESHOLD)
+        {
+            std::stable_sort(first, last, [&key](const T& a, const T& b) { return key(a) < key(b); });
+            return;
+        }
+
+        const uint32_t      max_blocks = detail::num_threads(pool) * detail::BLOCKS_PER_THREAD;
+        const size_t        block = std::max(size_t(detail::block_size<T>()), (count + max_blocks - 1) / max_blocks);
+        std::vector<size_t> histograms(size_t(detail::num_blocks(count, block)) * detail::RADIX_BUCKETS);
+        std::vector<T>      buffer(count);
+        bool                in_buffer = false;
+
+        for (uint32_t shift = 0; shift < sizeof(KeyType) * 8; shift += detail::RADIX_BITS)
+        {
+            const bool moved = in_buffer ? detail::radix_pass(pool, buffer.begin(), first, count, block, shift, key, histograms)
+                                         : detail::radix_pass(pool, first, buffer.begin(), count, block, shift, key, histograms);
+
+            in_buffer = moved ? !in_buffer : in_buffer;
+        }
+
+        if (in_buffer)
+            detail::move_range(pool, buffer.begin(), first, count);
+    }
+
+    template <typename Pool, typename RandomIt>
+    inline void radix_sort(Pool& pool, RandomIt first, RandomIt last)
+    {
+        radix_sort(pool, first, last, detail::RadixKey<typename std::iterator_traits<RandomIt>::value_type>());
+    }
+} // namespace algorithms
+} // namespace dw
@@ -0,0 +1,474 @@
+#pragma once
+
+#include "thread_pool.hpp"
+
+// Optional C++20 coroutine layer on top of dw::BasicThreadPool. Compiles to nothing on older standards, where the plain
+// Task/function(void*) API is all there is.
+#if defined(__has_include)
+#    if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+#        define DW_HAS_COROUTINES 1
+#    endif
+#endif
+
+#if !defined(DW_HAS_COROUTINES)
+#    define DW_HAS_COROUTINES 0
+#endif
+
+#if DW_HAS_COROUTINES
+
+#include <coroutine>
+#include <exception>
+#include <new>
+#include <vector>
+
+namespace dw
+{
+    template <typename T = void>
+    class task;
+
+    namespace detail
+    {
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Lets when_all() and sync_wait() find out when a set of coroutines has finished, whichever thread finishes last.
+    // sync_wait() sleeps in the pool, so it also leaves a way to wake it up.
+    struct CompletionCounter
+    {
+        std::atomic<uint32_t>   count;
+        std::coroutine_handle<> waiter;
+        void*                   pool = nullptr;
+        void (*notify)(void* pool) = nullptr;
+    };
+
+    template <typename Pool>
+    inline void notify_waiters(void* pool)
+    {
+        static_cast<Pool*>(pool)->notify_waiters();
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Every frame is followed by this trailer so operator delete knows whether to hand the block back to a pool, and
+    // how, since the pool type is gone by then. It sits behind the frame rather than in front, so operator new returns
+    // the block itself; GCC warns about deleting a pointer into the middle of an allocation.
+    struct alignas(16) FrameTrailer
+    {
+        void* pool;
+        void (*free)(void* pool, void* ptr, size_t size);
+
+        static size_t block_size(size_t frame_size) { return offset(frame_size) + sizeof(FrameTrailer); }
+
+        static FrameTrailer* of(void* frame, size_t frame_size)
+        {
+            return reinterpret_cast<FrameTrailer*>(static_cast<char*>(frame) + offset(frame_size));
+        }
+
+        static size_t offset(size_t frame_size) { return (frame_size + alignof(FrameTrailer) - 1) & ~size_t(alignof(FrameTrailer) - 1); }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    struct PromiseBase
+    {
+        struct FinalAwaiter
+        {
+            bool await_ready() const noexcept { return false; }
+
+            // Symmetric transfer to whoever is waiting on us, so long chains of co_await don't grow the stack.
+            template <typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+            {
+                PromiseBase& promise = handle.promise();
+
+                if (promise.counter)
+                {
+                    // Read everything up front, once the count drops the counter (and our frame) may be gone.
+                    CompletionCounter*      counter = promise.counter;
+                    std::coroutine_handle<> waiter = counter->waiter;
+                    void*                   pool = counter->pool;
+                    void (*notify)(void*) = counter->notify;
+
+                    if (counter->count.fetch_sub(1, std::memory_order_seq_cst) == 1)
+                    {
+                        if (notify)
+                            notify(pool);
+
+                        return waiter;
+                    }
+
+                    return std::noop_coroutine();
+                }
+
+                return promise.continuation ? promise.continuation : std::noop_coroutine();
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        std::coroutine_handle<> continuation;
+        CompletionCounter*      counter = nullptr;
+        std::exception_ptr      exception;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        template <typename Pool>
+        static void free_frame(void* pool, void* ptr, size_t size)
+        {
+            static_cast<Pool*>(pool)->free_frame(ptr, size);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Frames of coroutines that don't take a pool first come from the heap, see PoolPromise for the others.
+        static void* operator new(size_t size)
+        {
+            void* frame = aligned_malloc(FrameTrailer::block_size(size), alignof(FrameTrailer));
+
+            if (!frame)
+                throw std::bad_alloc();
+
+            FrameTrailer* trailer = FrameTrailer::of(frame, size);
+            trailer->pool = nullptr;
+            trailer->free = nullptr;
+            return frame;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        static void operator delete(void* ptr, size_t size)
+        {
+            FrameTrailer* trailer = FrameTrailer::of(ptr, size);
+
+            if (trailer->pool)
+                trailer->free(trailer->pool, ptr, FrameTrailer::block_size(size));
+            else
+                aligned_free(ptr);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Tasks are lazy, nothing runs until they are awaited.
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+
+        FinalAwaiter final_suspend() const noexcept { return {}; }
+
+        void unhandled_exception() noexcept { exception = std::current_exception(); }
+
+        void rethrow_if_exception()
+        {
+            if (exception)
+                std::rethrow_exception(exception);
+        }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    template <typename T>
+    struct Promise : PromiseBase
+    {
+        alignas(T) unsigned char storage[sizeof(T)];
+        bool                     has_value = false;
+
+        ~Promise()
+        {
+            if (has_value)
+                reinterpret_cast<T*>(storage)->~T();
+        }
+
+        task<T> get_return_object() noexcept;
+
+        template <typename U>
+        void return_value(U&& value)
+        {
+            new (storage) T(std::forward<U>(value));
+            has_value = true;
+        }
+
+        T& result()
+        {
+            rethrow_if_exception();
+            return *reinterpret_cast<T*>(storage);
+        }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    template <>
+    struct Promise<void> : PromiseBase
+    {
+        task<void> get_return_object() noexcept;
+
+        void return_void() noexcept {}
+
+        void result()
+        {
+            rethrow_if_exception();
+        }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Promise of coroutines whose first parameter is a pool, picked by the std::coroutine_traits specialization below.
+    // The frame comes from that pool. Only the first parameter is looked at: a pool further down the list, or the
+    // implicit object of a member coroutine in front of it, means a heap frame. Adds no members, so the task still
+    // sees a plain Promise<T>. Allocation and deallocation live in this one class; a templated operator new next
+    // to PromiseBase's delete makes GCC report every frame as mismatched (-Wmismatched-new-delete).
+    template <typename T, typename Traits, typename... Args>
+    struct PoolPromise final : Promise<T>
+    {
+        static void* operator new(size_t size, BasicThreadPool<Traits>& pool, Args&...)
+        {
+            void* frame = pool.allocate_frame(FrameTrailer::block_size(size));
+
+            if (!frame)
+                throw std::bad_alloc();
+
+            FrameTrailer* trailer = FrameTrailer::of(frame, size);
+            trailer->pool = &pool;
+            trailer->free = &PromiseBase::free_frame<BasicThreadPool<Traits> >;
+            return frame;
+        }
+
+        // Matches the operator new above, so a new-expression whose constructor throws hands the block back. Frames
+        // never get here, a coroutine always releases its frame through the sized delete below. The class is final
+        // and the only new-expression that picks this up places one PoolPromise, so that is the size.
+        static void operator delete(void* ptr, BasicThreadPool<Traits>&, Args&...)
+        {
+            PromiseBase::operator delete(ptr, sizeof(PoolPromise));
+        }
+
+        static void operator delete(void* ptr, size_t size)
+        {
+            PromiseBase::operator delete(ptr, size);
+        }
+    };
+
+    } // namespace detail
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Lazily started coroutine. co_await it from another coroutine to run it (the awaiting coroutine resumes when it
+    // finishes), use co_await pool.schedule() inside it to move onto a worker, and sync_wait() to block on it from
+    // regular code. Make the first parameter a ThreadPool& (or any BasicThreadPool&) to allocate the frame from the pool;
+    // any other parameter list, member coroutines included, allocates it with aligned_malloc.
+    template <typename T>
+    class task
+    {
+    public:
+        typedef detail::Promise<T> promise_type;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        task() noexcept : m_handle(nullptr) {}
+
+        explicit task(std::coroutine_handle<promise_type> handle) noexcept : m_handle(handle) {}
+
+        task(task&& other) noexcept : m_handle(other.m_handle)
+        {
+            other.m_handle = nullptr;
+        }
+
+        task& operator=(task&& other) noexcept
+        {
+            if (this != &other)
+            {
+                if (m_handle)
+                    m_handle.destroy();
+
+                m_handle = other.m_handle;
+                other.m_handle = nullptr;
+            }
+
+            return *this;
+        }
+
+        ~task()
+        {
+            if (m_handle)
+                m_handle.destroy();
+        }
+
+        task(const task&) = delete;
+        task& operator=(const task&) = delete;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        bool is_ready() const noexcept
+        {
+            return !m_handle || m_handle.done();
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Runs the task if it hasn't run yet and moves the result out of it.
+        auto operator co_await() && noexcept
+        {
+            return Awaiter<true>{ m_handle };
+        }
+
+        // Runs the task if it hasn't run yet and returns a reference to the result, which stays in the task. A task
+        // awaited this way can be awaited again and just hands out the result once more.
+        auto operator co_await() & noexcept
+        {
+            return Awaiter<false>{ m_handle };
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        std::coroutine_handle<promise_type> handle() const noexcept
+        {
+            return m_handle;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    private:
+        template <bool MOVE_RESULT>
+        struct Awaiter
+        {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() const noexcept { return !handle || handle.done(); }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+            {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+
+            decltype(auto) await_resume()
+            {
+                if constexpr (std::is_void<T>::value)
+                    handle.promise().result();
+                else if constexpr (MOVE_RESULT)
+                    return T(std::move(handle.promise().result()));
+                else
+                    return static_cast<T&>(handle.promise().result());
+            }
+        };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        std::coroutine_handle<promise_type> m_handle;
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    namespace detail
+    {
+    template <typename T>
+    inline task<T> Promise<T>::get_return_object() noexcept
+    {
+        return task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+    }
+
+    inline task<void> Promise<void>::get_return_object() noexcept
+    {
+        return task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    template <typename T>
+    struct WhenAllAwaiter
+    {
+        std::vector<task<T>> tasks;
+        CompletionCounter    counter;
+
+        explicit WhenAllAwaiter(std::vector<task<T>>&& children) : tasks(std::move(children)) {}
+
+        bool await_ready() const noexcept { return tasks.empty(); }
+
+        // Starts every child on the current thread. Children that co_await pool.schedule() hop onto workers right
+        // away, so they run in parallel; whichever finishes last resumes the awaiting coroutine.
+        bool await_suspend(std::coroutine_handle<> awaiting) noexcept
+        {
+            counter.count.store(uint32_t(tasks.size() + 1), std::memory_order_relaxed);
+            counter.waiter = awaiting;
+
+            for (size_t i = 0; i < tasks.size(); i++)
+            {
+                tasks[i].handle().promise().counter = &counter;
+                tasks[i].handle().resume();
+            }
+
+            // If all children are already done there is nothing to suspend for.
+            return counter.count.fetch_sub(1, std::memory_order_acq_rel) != 1;
+        }
+
+        auto await_resume()
+        {
+            if constexpr (std::is_void<T>::value)
+            {
+                for (size_t i = 0; i < tasks.size(); i++)
+                    tasks[i].handle().promise().result();
+            }
+            else
+            {
+                std::vector<T> results;
+                results.reserve(tasks.size());
+
+                for (size_t i = 0; i < tasks.size(); i++)
+                    results.push_back(std::move(tasks[i].handle().promise().result()));
+
+                return results;
+            }
+        }
+    };
+    } // namespace detail
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // co_await when_all(std::move(tasks)) runs every task and resumes once all of them are done. Yields a
+    // std::vector<T> of the results (nothing for task<void>).
+    template <typename T>
+    inline detail::WhenAllAwaiter<T> when_all(std::vector<task<T>> tasks)
+    {
+        return detail::WhenAllAwaiter<T>(std::move(tasks));
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Runs a task from regular (non-coroutine) code and blocks until it is done, executing pool tasks meanwhile and
+    // sleeping once there are none.
+    template <typename Traits, typename T>
+    inline auto sync_wait(BasicThreadPool<Traits>& pool, task<T>& t)
+    {
+        detail::CompletionCounter counter;
+        counter.count.store(2, std::memory_order_relaxed);
+        counter.waiter = std::noop_coroutine();
+        counter.pool = &pool;
+        counter.notify = &detail::notify_waiters<BasicThreadPool<Traits> >;
+
+        t.handle().promise().counter = &counter;
+        t.handle().resume();
+
+        if (counter.count.fetch_sub(1, std::memory_order_seq_cst) != 1)
+            pool.wait_for_counter(counter.count);
+
+        if constexpr (std::is_void<T>::value)
+            t.handle().promise().result();
+        else
+            return std::move(t.handle().promise().result());
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    template <typename Traits, typename T>
+    inline auto sync_wait(BasicThreadPool<Traits>& pool, task<T>&& t)
+    {
+        return sync_wait(pool, t);
+    }
+} // namespace dw
+
+// Coroutines returning a dw::task whose first parameter is a pool get a promise that allocates the frame there.
+template <typename T, typename Traits, typename... Args>
+struct std::coroutine_traits<dw::task<T>, dw::BasicThreadPool<Traits>&, Args...>
+{
+    typedef dw::detail::PoolPromise<T, Traits, Args...> promise_type;
+};
+
+#endif
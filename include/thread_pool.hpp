@@ -1,398 +1,5227 @@
 #pragma once
 
-#include <functional>
 #include <thread>
 #include <vector>
 #include <atomic>
+#include <chrono>
 #include <algorithm>
 #include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-#define MAX_TASKS 1024u
-#define MAX_DEPENDENCIES 16u
-#define MAX_CONTINUATIONS 16u
-#define MASK MAX_TASKS - 1u
-#define TASK_SIZE_BYTES 128
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <malloc.h>
+#endif
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Default for DefaultThreadPoolTraits::STATS, the per-worker counters and latency histograms behind stats().
+// Off by default, build with THREAD_POOL_STATS=1 to turn them on for dw::ThreadPool.
+#ifndef THREAD_POOL_STATS
+#define THREAD_POOL_STATS 0
+#endif
+
+// Debug checks for the frame arena: poisons memory on reset_frame_arena() and catches payload tasks that run after
+// the arena they live in was reset. On unless NDEBUG is defined.
+#ifndef THREAD_POOL_ARENA_CHECKS
+#ifdef NDEBUG
+#define THREAD_POOL_ARENA_CHECKS 0
+#else
+#define THREAD_POOL_ARENA_CHECKS 1
+#endif
+#endif
+
+// Default for DefaultThreadPoolTraits::TRACE, the per-thread event rings behind dump_trace(). Off by default, build
+// with THREAD_POOL_TRACE=1 to turn them on for dw::ThreadPool.
+#ifndef THREAD_POOL_TRACE
+#define THREAD_POOL_TRACE 0
+#endif
 
 namespace dw
 {
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-class Semaphore
-{
-public:
-	Semaphore() : m_signal(false) {}
+    // Returned by current_numa_node() outside the pool, and the "no preference" value of set_numa_node().
+    constexpr uint32_t INVALID_NUMA_NODE = 0xFFu;
+
+    // Internal tuning constants. Whatever should differ between pools lives in the traits instead.
+    namespace detail
+    {
+    constexpr uint32_t CACHE_LINE_SIZE = 64u;
+    constexpr uint32_t INVALID_WORKER_INDEX = 0xFFFFFFFFu;
+    constexpr uint32_t WORKER_SPIN_COUNT = 64u;
+    constexpr uint32_t WAIT_SPIN_COUNT = 256u;
+    constexpr uint32_t WORKER_IDLE_TIMEOUT_MS = 100u;
+    constexpr uint32_t WORKER_SPAWN_BACKLOG = 4u;
+    constexpr uint32_t TASK_SLAB_SIZE = 1024u;
+    constexpr uint32_t MAX_EDGE_SLABS = 1024u;
+    constexpr uint32_t TASK_CACHE_SIZE = 128u;
+    constexpr uint32_t INVALID_TASK_INDEX = 0xFFFFFFFFu;
+    constexpr uint32_t TASK_FLAG_STATIC = 0x01u;
+    constexpr uint32_t TASK_FLAG_FUTURE = 0x02u;
+    constexpr uint32_t TASK_FLAG_OWNS_DATA = 0x04u;
+    constexpr uint32_t TASK_FLAG_SKIPPED = 0x08u;
+    constexpr uint32_t PREDECESSOR_CANCELLED = 0x80000000u;
+    constexpr uint32_t PREDECESSOR_COUNT_MASK = 0x7FFFFFFFu;
+    constexpr uint32_t FUTURE_STORAGE_OFFSET = 16u;
+    constexpr uint32_t NUM_TASK_PRIORITIES = 3u;
+    constexpr uint32_t PRIORITY_AGING_INTERVAL = 16u;
+    constexpr uint32_t NUM_STEAL_TIERS = 4u;
+    constexpr uint32_t TASK_BATCH_SIZE = 64u;
+    constexpr uint32_t LATENCY_BUCKETS = 40u;
+    constexpr uint32_t FRAME_MIN_BLOCK_SIZE = 64u;
+    constexpr uint32_t FRAME_SIZE_CLASSES = 7u;
+    constexpr uint32_t FRAME_CACHE_SIZE = 32u;
+    constexpr uint32_t FRAME_CHUNK_SIZE = 64u * 1024u;
+    constexpr uint32_t ARENA_BLOCK_SIZE = 256u * 1024u;
+    constexpr uint32_t ARENA_ALLOCATION_MAGIC = 0xA3E9A3E9u;
+    constexpr uint8_t  ARENA_POISON = 0xDD;
+    } // namespace detail
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+inline void cpu_pause()
+{
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+	_mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Lets idle threads sleep without the notifying side paying for a lock when nobody is asleep.
+// A waiter calls prepare_wait(), re-checks its condition and then either cancel_wait() or commit_wait().
+class EventCount
+{
+public:
+	EventCount() : m_epoch(0), m_waiters(0) {}
+
+	inline uint32_t prepare_wait()
+	{
+		m_waiters.fetch_add(1, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		return m_epoch.load(std::memory_order_acquire);
+	}
+
+	inline void cancel_wait()
+	{
+		m_waiters.fetch_sub(1, std::memory_order_seq_cst);
+	}
+
+	inline void commit_wait(uint32_t key)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_condition.wait(lock, [&] { return m_epoch.load(std::memory_order_relaxed) != key; });
+		m_waiters.fetch_sub(1, std::memory_order_seq_cst);
+	}
+
+	// Same as commit_wait() but gives up at deadline. Returns false if it timed out.
+	inline bool commit_wait_until(uint32_t key, const std::chrono::steady_clock::time_point& deadline)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		const bool woken = m_condition.wait_until(lock, deadline, [&] { return m_epoch.load(std::memory_order_relaxed) != key; });
+		m_waiters.fetch_sub(1, std::memory_order_seq_cst);
+		return woken;
+	}
+
+	inline void notify_one()
+	{
+		if (has_waiters())
+		{
+			advance_epoch();
+			m_condition.notify_one();
+		}
+	}
+
+	// Wakes up to count waiters, all of them if there are fewer.
+	inline void notify(uint32_t count)
+	{
+		if (count != 0 && has_waiters())
+		{
+			advance_epoch();
+
+			if (count >= num_waiters())
+				m_condition.notify_all();
+			else
+			{
+				for (uint32_t i = 0; i < count; i++)
+					m_condition.notify_one();
+			}
+		}
+	}
+
+	inline void notify_all()
+	{
+		if (has_waiters())
+		{
+			advance_epoch();
+			m_condition.notify_all();
+		}
+	}
+
+	inline bool has_waiters()
+	{
+		// Pairs with the fence in prepare_wait(): either we see the waiter, or it sees whatever we published.
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		return m_waiters.load(std::memory_order_relaxed) != 0;
+	}
+
+	inline uint32_t num_waiters()
+	{
+		return m_waiters.load(std::memory_order_relaxed);
+	}
+
+private:
+
+	EventCount(const EventCount &);
+	EventCount & operator = (const EventCount &);
+
+	inline void advance_epoch()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_epoch.fetch_add(1, std::memory_order_release);
+	}
+
+	std::mutex              m_mutex;
+	std::condition_variable m_condition;
+	std::atomic<uint32_t>   m_epoch;
+	std::atomic<uint32_t>   m_waiters;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // How a BasicThreadPool hands tasks between threads.
+    enum class QueuePolicy : uint8_t
+    {
+        MUTEX,        // One shared queue per priority behind a mutex. Strict ordering, no stealing.
+        LOCK_FREE,    // One shared bounded lock-free ring per priority, overflowing into a mutex queue. FIFO only.
+        WORK_STEALING // Per-worker Chase-Lev deques plus shared injection queues for everyone else.
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // What idle workers and waiting threads do once they run out of work.
+    enum class WaitPolicy : uint8_t
+    {
+        SPIN_THEN_SLEEP, // Spin for a bit, then park (workers) or sleep (waiters).
+        SPIN,            // Never sleep. Lowest wake-up latency, but idle threads keep their cores busy.
+        SLEEP            // Park or sleep right after coming up empty, for throughput pools that share the machine.
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Compile-time configuration of a BasicThreadPool. Derive from it and override what should differ, e.g.
+    //
+    //     struct LowLatencyTraits : dw::DefaultThreadPoolTraits
+    //     {
+    //         static const dw::WaitPolicy WAIT_POLICY = dw::WaitPolicy::SPIN;
+    //     };
+    //
+    //     dw::BasicThreadPool<LowLatencyTraits> pool;
+    struct DefaultThreadPoolTraits
+    {
+        static const uint32_t    QUEUE_CAPACITY = 1024;     // Tasks per worker deque and lock-free ring, a power of two.
+        static const uint32_t    TASK_SIZE_BYTES = 128;     // Inline payload per task: callables, futures, task_data().
+        static const uint32_t    MAX_DEPENDENCIES = 16;     // Incoming define_dependency() edges per task.
+        static const uint32_t    MAX_CONTINUATIONS = 16;    // Added to MAX_DEPENDENCIES for the outgoing edges per task.
+        static const uint32_t    EDGE_SLAB_SIZE = 256;      // Edge blocks allocated at once.
+        static const uint32_t    MAX_TASKS = 1024 * 1024;   // Tasks alive at once, allocate() fails past it. Multiple of 1024 above that.
+        static const uint32_t    TRACE_BUFFER_SIZE = 16384; // Events each thread's trace ring keeps with TRACE on.
+        static const QueuePolicy QUEUE_POLICY = QueuePolicy::WORK_STEALING;
+        static const WaitPolicy  WAIT_POLICY = WaitPolicy::SPIN_THEN_SLEEP;
+        static const bool        STATS = THREAD_POOL_STATS != 0;
+        static const bool        TRACE = THREAD_POOL_TRACE != 0;
+    };
+
+    template <typename Traits>
+    class BasicThreadPool;
+
+    typedef BasicThreadPool<DefaultThreadPoolTraits> ThreadPool;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    template <typename Traits>
+    struct BasicTask;
+
+    typedef void (*TaskFunction)(void*);
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Workers always drain higher priorities first, with periodic aging so lower priorities can't starve.
+    enum class TaskPriority : uint8_t
+    {
+        CRITICAL = 0,
+        NORMAL = 1,
+        BACKGROUND = 2
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Order in which a worker takes tasks of one priority level from its own deque. The shared queues and stealing
+    // are always oldest first, so externally submitted work can't be starved by newer submissions.
+    enum class QueueOrder : uint8_t
+    {
+        LIFO,
+        FIFO
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Outgoing edges (continuations and dependents) live in a side pool, so tasks without edges never pay for it.
+    template <typename Traits>
+    struct BasicTaskEdges
+    {
+        static const uint32_t MAX_SUCCESSORS = Traits::MAX_DEPENDENCIES + Traits::MAX_CONTINUATIONS;
+
+        uint32_t              num_successors;
+        uint32_t              index;
+        std::atomic<uint32_t> next_free;
+        BasicTask<Traits>*    successors[MAX_SUCCESSORS];
+
+        BasicTaskEdges() : num_successors(0), index(detail::INVALID_TASK_INDEX), next_free(detail::INVALID_TASK_INDEX) {}
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Task field that only exists when a trait is on. The disabled version is empty, ignores writes and reads as zero,
+    // so the code using it doesn't need to be compiled out.
+    template <typename T, bool ENABLED>
+    struct OptionalField
+    {
+        T value;
+
+        OptionalField() : value() {}
+
+        inline void set(T v) { value = v; }
+        inline T get() const { return value; }
+    };
+
+    template <typename T>
+    struct OptionalField<T, false>
+    {
+        inline void set(T) {}
+        inline T get() const { return T(); }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    class TaskGroup;
+
+    template <typename Traits>
+    struct alignas(detail::CACHE_LINE_SIZE) BasicTask
+    {
+        typedef BasicTaskEdges<Traits> Edges;
+
+        // Written by other threads while the task is in flight, so they get a cache line to themselves.
+        std::atomic<uint32_t> num_pending;
+        std::atomic<uint32_t> num_predecessors;
+        std::atomic<uint32_t> generation;
+        std::atomic<uint32_t> num_refs;
+        std::atomic<uint32_t> next_free;
+        std::atomic<uint32_t> num_waiters; // Threads sleeping on this task, survives recycling so waits stay balanced.
+        std::atomic<uint32_t> edge_state;  // Future tasks only, lets then() add a continuation while the task runs.
+        std::atomic<uint32_t> num_open;    // The task's own run plus children that haven't finished yet.
+        BasicTask*            parent;      // Set up front, only here because the line has room for it.
+        char                  padding[detail::CACHE_LINE_SIZE - 8 * sizeof(std::atomic<uint32_t>) - sizeof(BasicTask*)];
+
+        // Only written by the thread that sets the task up, before it is enqueued.
+        TaskFunction           function;
+        Edges*                 edges;
+        std::atomic<uint32_t>* counter;
+        TaskGroup*             group;
+        uint32_t               index;
+        uint16_t               num_dependencies;
+        uint16_t               num_continuation_parents;
+        uint8_t                flags;
+        TaskPriority           priority;
+        uint8_t                numa_node;
+
+        // Both fit in the padding before data when enabled, and take a byte of it when not.
+        OptionalField<uint64_t, Traits::STATS>    ready_time; // When the task was pushed.
+        OptionalField<const char*, Traits::TRACE> name;       // Shows up in dump_trace().
+
+        alignas(16) char       data[Traits::TASK_SIZE_BYTES];
+
+        BasicTask() : num_pending(0), num_predecessors(0), generation(0), num_refs(0), next_free(detail::INVALID_TASK_INDEX), num_waiters(0), edge_state(0), num_open(0), parent(nullptr), function(nullptr), edges(nullptr), counter(nullptr), group(nullptr), index(detail::INVALID_TASK_INDEX), num_dependencies(0), num_continuation_parents(0), flags(0), priority(TaskPriority::NORMAL), numa_node(INVALID_NUMA_NODE) {}
+    };
+
+    typedef BasicTask<DefaultThreadPoolTraits>      Task;
+    typedef BasicTaskEdges<DefaultThreadPoolTraits> TaskEdges;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Stable reference to a task. Once the task finishes and its slot is recycled the generation no longer
+    // matches, so a stale handle reads as done instead of aliasing whatever task reuses the slot.
+    struct TaskHandle
+    {
+        uint32_t index;
+        uint32_t generation;
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Tasks added with ThreadPool::set_group() can be waited on and cancelled as a unit. Cancelling is cooperative:
+    // tasks that haven't started yet are skipped, along with their continuations and dependents, while running ones
+    // finish unless they poll a token(). Skipped tasks still count as finished for every kind of wait.
+    class TaskGroup
+    {
+    public:
+        TaskGroup() : m_num_pending(0), m_cancelled(false), m_deadline(0) {}
+
+        inline void cancel()
+        {
+            m_cancelled.store(true, std::memory_order_relaxed);
+        }
+
+        // Sheds stale work: tasks of the group that haven't started by time are skipped as if cancel() was called.
+        template <typename Clock, typename Duration>
+        inline void expire_at(const std::chrono::time_point<Clock, Duration>& time)
+        {
+            const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(time - Clock::now());
+            m_deadline.store(std::max<int64_t>(int64_t(deadline.time_since_epoch().count()), 1), std::memory_order_relaxed);
+        }
+
+        template <typename Rep, typename Period>
+        inline void expire_after(const std::chrono::duration<Rep, Period>& timeout)
+        {
+            expire_at(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout));
+        }
+
+        inline bool is_cancelled() const
+        {
+            if (m_cancelled.load(std::memory_order_relaxed))
+                return true;
+
+            const int64_t deadline = m_deadline.load(std::memory_order_relaxed);
+            return deadline != 0 && int64_t(std::chrono::steady_clock::now().time_since_epoch().count()) >= deadline;
+        }
+
+        // True once every task in the group has finished or was skipped.
+        inline bool is_done() const
+        {
+            return m_num_pending.load(std::memory_order_acquire) == 0;
+        }
+
+        // Clears cancel() and expire_at(), so a finished group can be used again.
+        inline void reset()
+        {
+            m_cancelled.store(false, std::memory_order_relaxed);
+            m_deadline.store(0, std::memory_order_relaxed);
+        }
+
+        // Lets a running task find out that its group was cancelled, so it can stop early.
+        class Token
+        {
+        public:
+            Token() : m_group(nullptr) {}
+            explicit Token(const TaskGroup* group) : m_group(group) {}
+
+            inline bool is_cancelled() const
+            {
+                return m_group && m_group->is_cancelled();
+            }
+
+        private:
+            const TaskGroup* m_group;
+        };
+
+        inline Token token() const
+        {
+            return Token(this);
+        }
+
+    private:
+        template <typename>
+        friend class BasicThreadPool;
+
+        TaskGroup(const TaskGroup&);
+        TaskGroup& operator=(const TaskGroup&);
+
+        std::atomic<uint32_t> m_num_pending;
+        std::atomic<bool>     m_cancelled;
+        std::atomic<int64_t>  m_deadline; // steady_clock ticks, 0 if the group doesn't expire.
+    };
+
+    typedef TaskGroup::Token CancellationToken;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    template <typename T, typename Traits>
+    inline T* task_data(BasicTask<Traits>* task)
+    {
+        return (T*)(&task->data[0]);
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    template <typename T, typename Traits = DefaultThreadPoolTraits>
+    class Future;
+
+    template <typename T>
+    struct VoidType
+    {
+        typedef void type;
+    };
+
+    // Result type of calling a callable without arguments. Has no type for anything else, so the submit() overloads
+    // drop out of overload resolution instead of failing to compile.
+    template <typename F, typename = void>
+    struct CallResult
+    {
+    };
+
+    template <typename F>
+    struct CallResult<F, typename VoidType<decltype(std::declval<typename std::decay<F>::type&>()())>::type>
+    {
+        typedef decltype(std::declval<typename std::decay<F>::type&>()()) type;
+    };
+
+    // Calls the function given to Future<T>::then() with the parent's result, storage being the parent's task data
+    // at FUTURE_STORAGE_OFFSET.
+    template <typename T>
+    struct ThenInvoke
+    {
+        template <typename F>
+        static auto call(F& function, char* storage) -> decltype(function(std::declval<T&>()))
+        {
+            return function(*reinterpret_cast<T*>(storage));
+        }
+    };
+
+    template <>
+    struct ThenInvoke<void>
+    {
+        template <typename F>
+        static auto call(F& function, char*) -> decltype(function())
+        {
+            return function();
+        }
+    };
+
+    template <typename T, typename F>
+    struct ThenResult
+    {
+        typedef decltype(ThenInvoke<T>::call(std::declval<typename std::decay<F>::type&>(), static_cast<char*>(nullptr))) type;
+    };
+
+    // Room a future result takes in the task data, none for void.
+    template <typename T>
+    struct FutureStorage
+    {
+        static const size_t size = sizeof(T);
+        static const size_t alignment = alignof(T);
+    };
+
+    template <>
+    struct FutureStorage<void>
+    {
+        static const size_t size = 0;
+        static const size_t alignment = 1;
+    };
+
+    // Future tasks keep this at the start of their data, followed by the callable and later the result at
+    // FUTURE_STORAGE_OFFSET. Whoever gets there second (the task publishing its result or the future being
+    // dropped) destroys the result.
+    enum FutureState : uint32_t
+    {
+        FUTURE_PENDING,
+        FUTURE_READY,
+        FUTURE_ABANDONED,
+        FUTURE_CANCELLED
+    };
+
+    // Task::edge_state of future tasks. then() locks the edges to add a continuation, run_task() seals them before
+    // releasing successors, after which then() enqueues the continuation itself.
+    enum EdgeState : uint32_t
+    {
+        EDGES_OPEN,
+        EDGES_LOCKED,
+        EDGES_SEALED
+    };
+
+    // Identifies the pool (if any) that owns the calling thread, and which worker it is. Pools of every traits type
+    // share it, hence the untyped pointer that is only ever compared.
+    struct ThreadContext
+    {
+        const void* pool;
+        uint32_t    worker_index;
+        uint32_t    rng_state;
+        uint32_t    num_picks;
+        bool        discarding; // Set while run_task() calls a cancelled task that only has to destroy its data.
+    };
+
+    inline ThreadContext& thread_context()
+    {
+        static thread_local ThreadContext context = { nullptr, detail::INVALID_WORKER_INDEX, 0, 0, false };
+        return context;
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Fixed capacity Chase-Lev deque. The owning worker pushes and pops at the bottom, every other
+    // thread steals from the top. Based on "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al. 2013).
+    template <typename Traits>
+    struct WorkStealingDeque
+    {
+        typedef BasicTask<Traits> Task;
+
+        static const uint32_t CAPACITY = Traits::QUEUE_CAPACITY;
+        static const uint32_t MASK = CAPACITY - 1u;
+
+        std::atomic<int64_t> m_top;
+        char                 m_padding0[detail::CACHE_LINE_SIZE - sizeof(std::atomic<int64_t>)];
+        std::atomic<int64_t> m_bottom;
+        char                 m_padding1[detail::CACHE_LINE_SIZE - sizeof(std::atomic<int64_t>)];
+        std::atomic<Task*>   m_buffer[CAPACITY];
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        WorkStealingDeque()
+        {
+            m_top = 0;
+            m_bottom = 0;
+
+            for (uint32_t i = 0; i < CAPACITY; i++)
+                m_buffer[i].store(nullptr, std::memory_order_relaxed);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Owner only. Returns false if the deque is full.
+        bool push(Task* task)
+        {
+            const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+            const int64_t top = m_top.load(std::memory_order_acquire);
+
+            if (bottom - top >= int64_t(CAPACITY))
+                return false;
+
+            m_buffer[bottom & MASK].store(task, std::memory_order_relaxed);
+            m_bottom.store(bottom + 1, std::memory_order_release);
+
+            return true;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Owner only. Publishes as many tasks as fit with a single bottom update, returns how many that was.
+        uint32_t push_batch(Task** tasks, uint32_t count)
+        {
+            const int64_t  bottom = m_bottom.load(std::memory_order_relaxed);
+            const int64_t  top = m_top.load(std::memory_order_acquire);
+            const uint32_t num_free = uint32_t(int64_t(CAPACITY) - (bottom - top));
+            const uint32_t num_pushed = count < num_free ? count : num_free;
+
+            for (uint32_t i = 0; i < num_pushed; i++)
+                m_buffer[(bottom + i) & MASK].store(tasks[i], std::memory_order_relaxed);
+
+            m_bottom.store(bottom + num_pushed, std::memory_order_release);
+
+            return num_pushed;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Owner only.
+        Task* pop()
+        {
+            const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+            m_bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t top = m_top.load(std::memory_order_relaxed);
+
+            if (top > bottom)
+            {
+                m_bottom.store(bottom + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            Task* task = m_buffer[bottom & MASK].load(std::memory_order_relaxed);
+
+            // Last item, race against thieves for it.
+            if (top == bottom)
+            {
+                if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    task = nullptr;
+
+                m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+
+            return task;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Any thread. Returns nullptr if the deque is empty or another thread won the race.
+        Task* steal()
+        {
+            int64_t top = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+            if (top >= bottom)
+                return nullptr;
+
+            Task* task = m_buffer[top & MASK].load(std::memory_order_relaxed);
+
+            if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return nullptr;
+
+            return task;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        bool empty()
+        {
+            return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Approximate unless called by the owner.
+        uint32_t size()
+        {
+            const int64_t size = m_bottom.load(std::memory_order_relaxed) - m_top.load(std::memory_order_relaxed);
+            return size > 0 ? uint32_t(size) : 0;
+        }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Stands in for the worker deques with the shared queue policies. Never holds anything, so every task goes
+    // through the shared queues and stealing finds nothing.
+    template <typename Traits>
+    struct NullDeque
+    {
+        typedef BasicTask<Traits> Task;
+
+        inline bool push(Task*) { return false; }
+        inline uint32_t push_batch(Task**, uint32_t) { return 0; }
+        inline Task* pop() { return nullptr; }
+        inline Task* steal() { return nullptr; }
+        inline bool empty() { return true; }
+        inline uint32_t size() { return 0; }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Shared queue used by threads that don't own a deque (and as overflow for full deques).
+    template <typename Traits>
+    struct InjectionQueue
+    {
+        typedef BasicTask<Traits> Task;
+
+        std::mutex			  m_critical_section;
+        std::vector<Task*>    m_task_queue;
+        uint32_t			  m_front;
+        uint32_t			  m_back;
+        std::atomic<uint32_t> m_size;
+        std::atomic<uint32_t> m_high_water; // Only kept up to date with Traits::STATS.
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        InjectionQueue()
+        {
+            m_task_queue.resize(Traits::QUEUE_CAPACITY);
+            m_front = 0;
+            m_back = 0;
+            m_size = 0;
+            m_high_water = 0;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        void push(Task* task)
+        {
+            std::lock_guard<std::mutex> lock(m_critical_section);
+
+            // Grow instead of overwriting queued tasks. Capacity is always a power of two.
+            if (m_back - m_front == m_task_queue.size())
+                grow();
+
+            m_task_queue[m_back & (m_task_queue.size() - 1)] = task;
+            ++m_back;
+            m_size.store(m_back - m_front, std::memory_order_release);
+
+            if (Traits::STATS && m_back - m_front > m_high_water.load(std::memory_order_relaxed))
+                m_high_water.store(m_back - m_front, std::memory_order_relaxed);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        void push_batch(Task** tasks, uint32_t count)
+        {
+            std::lock_guard<std::mutex> lock(m_critical_section);
+
+            while (m_back - m_front + count > m_task_queue.size())
+                grow();
+
+            for (uint32_t i = 0; i < count; i++)
+                m_task_queue[(m_back + i) & (m_task_queue.size() - 1)] = tasks[i];
+
+            m_back += count;
+            m_size.store(m_back - m_front, std::memory_order_release);
+
+            if (Traits::STATS && m_back - m_front > m_high_water.load(std::memory_order_relaxed))
+                m_high_water.store(m_back - m_front, std::memory_order_relaxed);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        Task* pop()
+        {
+            // Cheap early out so idle threads don't hammer the lock.
+            if (m_size.load(std::memory_order_acquire) == 0)
+                return nullptr;
+
+            std::lock_guard<std::mutex> lock(m_critical_section);
+
+            if (m_back == m_front)
+                return nullptr;
+
+            Task* task = m_task_queue[m_front++ & (m_task_queue.size() - 1)];
+
+            m_size.store(m_back - m_front, std::memory_order_release);
+
+            return task;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        bool empty()
+        {
+            return m_size.load(std::memory_order_acquire) == 0;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        uint32_t high_water()
+        {
+            return m_high_water.load(std::memory_order_relaxed);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    private:
+        void grow()
+        {
+            const uint32_t     capacity = uint32_t(m_task_queue.size());
+            std::vector<Task*> queue(capacity * 2);
+
+            for (uint32_t i = m_front; i != m_back; i++)
+                queue[i - m_front] = m_task_queue[i & (capacity - 1)];
+
+            m_back = m_back - m_front;
+            m_front = 0;
+            m_task_queue.swap(queue);
+        }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Bounded multi-producer multi-consumer ring in the style of Vyukov's queue: each cell carries a sequence number
+    // that tells producers and consumers whose turn it is, so neither side ever takes a lock. Whatever doesn't fit
+    // spills into a mutex queue, which is only looked at while it holds something. Always FIFO, the order argument
+    // is ignored.
+    template <typename Traits>
+    struct LockFreeQueue
+    {
+        typedef BasicTask<Traits> Task;
+
+        static const uint32_t CAPACITY = Traits::QUEUE_CAPACITY;
+        static const uint32_t MASK = CAPACITY - 1u;
+
+        struct Cell
+        {
+            std::atomic<uint64_t> sequence;
+            Task*                 task;
+        };
+
+        std::atomic<uint64_t>  m_enqueue_position;
+        char                   m_padding0[detail::CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+        std::atomic<uint64_t>  m_dequeue_position;
+        char                   m_padding1[detail::CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+        std::atomic<uint32_t>  m_high_water; // Only kept up to date with Traits::STATS.
+        std::unique_ptr<Cell[]> m_cells;
+        InjectionQueue<Traits> m_overflow;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        LockFreeQueue() : m_enqueue_position(0), m_dequeue_position(0), m_high_water(0), m_cells(new Cell[CAPACITY])
+        {
+            for (uint32_t i = 0; i < CAPACITY; i++)
+            {
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+                m_cells[i].task = nullptr;
+            }
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        void push(Task* task)
+        {
+            if (!try_push(task))
+                m_overflow.push(task);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        void push_batch(Task** tasks, uint32_t count)
+        {
+            uint32_t num_pushed = 0;
+
+            while (num_pushed < count && try_push(tasks[num_pushed]))
+                num_pushed++;
+
+            if (num_pushed < count)
+                m_overflow.push_batch(tasks + num_pushed, count - num_pushed);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        Task* pop()
+        {
+            uint64_t position = m_dequeue_position.load(std::memory_order_relaxed);
+
+            for (;;)
+            {
+                Cell&         cell = m_cells[position & MASK];
+                const int64_t difference = int64_t(cell.sequence.load(std::memory_order_acquire)) - int64_t(position + 1);
+
+                if (difference == 0)
+                {
+                    if (m_dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        Task* task = cell.task;
+                        cell.sequence.store(position + CAPACITY, std::memory_order_release);
+                        return task;
+                    }
+                }
+                else if (difference < 0)
+                    return m_overflow.pop();
+                else
+                    position = m_dequeue_position.load(std::memory_order_relaxed);
+            }
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        bool empty()
+        {
+            return m_dequeue_position.load(std::memory_order_acquire) >= m_enqueue_position.load(std::memory_order_acquire) && m_overflow.empty();
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        uint32_t high_water()
+        {
+            return std::max(m_high_water.load(std::memory_order_relaxed), m_overflow.high_water());
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    private:
+        // Returns false if the ring is full.
+        bool try_push(Task* task)
+        {
+            uint64_t position = m_enqueue_position.load(std::memory_order_relaxed);
+
+            for (;;)
+            {
+                Cell&         cell = m_cells[position & MASK];
+                const int64_t difference = int64_t(cell.sequence.load(std::memory_order_acquire)) - int64_t(position);
+
+                if (difference == 0)
+                {
+                    if (m_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (difference < 0)
+                    return false;
+                else
+                    position = m_enqueue_position.load(std::memory_order_relaxed);
+            }
+
+            m_cells[position & MASK].task = task;
+            m_cells[position & MASK].sequence.store(position + 1, std::memory_order_release);
+
+            if (Traits::STATS)
+            {
+                const uint64_t depth = position + 1 - m_dequeue_position.load(std::memory_order_relaxed);
+
+                if (depth < CAPACITY && depth > m_high_water.load(std::memory_order_relaxed))
+                    m_high_water.store(uint32_t(depth), std::memory_order_relaxed);
+            }
+
+            return true;
+        }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Log2 buckets of nanoseconds: bucket i counts samples in [2^i, 2^(i+1)), bucket 0 also takes 0.
+    struct LatencyHistogram
+    {
+        uint64_t buckets[detail::LATENCY_BUCKETS];
+
+        LatencyHistogram()
+        {
+            for (uint32_t i = 0; i < detail::LATENCY_BUCKETS; i++)
+                buckets[i] = 0;
+        }
+
+        inline uint64_t count() const
+        {
+            uint64_t total = 0;
+
+            for (uint32_t i = 0; i < detail::LATENCY_BUCKETS; i++)
+                total += buckets[i];
+
+            return total;
+        }
+
+        // Upper bound (in ns) of the bucket holding the given percentile (0-100), 0 if there are no samples.
+        inline uint64_t percentile(double p) const
+        {
+            const uint64_t total = count();
+            const uint64_t rank = uint64_t(double(total) * p / 100.0);
+            uint64_t       seen = 0;
+
+            if (total == 0)
+                return 0;
+
+            for (uint32_t i = 0; i < detail::LATENCY_BUCKETS; i++)
+            {
+                seen += buckets[i];
+
+                if (seen > rank || i == detail::LATENCY_BUCKETS - 1)
+                    return uint64_t(1) << (i + 1);
+            }
+
+            return 0;
+        }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    struct WorkerStats
+    {
+        uint64_t tasks_executed;
+        uint64_t steals_attempted;
+        uint64_t steals_succeeded;
+        uint64_t busy_ns;         // Running tasks.
+        uint64_t idle_ns;         // Spinning and searching for work.
+        uint64_t parked_ns;       // Asleep in the parking lot.
+        uint64_t wakeups;
+        uint64_t max_queue_depth; // High-water mark of the worker's deques.
+
+        WorkerStats() : tasks_executed(0), steals_attempted(0), steals_succeeded(0), busy_ns(0), idle_ns(0), parked_ns(0), wakeups(0), max_queue_depth(0) {}
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Snapshot returned by BasicThreadPool::stats(). Everything is zero unless the pool's traits turn STATS on.
+    struct ThreadPoolStats
+    {
+        std::vector<WorkerStats> workers;
+        WorkerStats              total;               // Workers plus threads helping from outside the pool.
+        uint64_t                 max_injection_depth; // High-water mark of the shared injection queues.
+        LatencyHistogram         wait_latency;        // Enqueue (or becoming runnable) to start.
+        LatencyHistogram         run_latency;         // Start to finish.
+
+        ThreadPoolStats() : max_injection_depth(0) {}
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline uint64_t now_ns()
+    {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline uint32_t latency_bucket(uint64_t ns)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        const uint32_t bucket = ns > 1 ? 63u - uint32_t(__builtin_clzll(ns)) : 0;
+#else
+        uint32_t bucket = 0;
+
+        while (ns > 1)
+        {
+            ns >>= 1;
+            bucket++;
+        }
+#endif
+
+        return bucket < detail::LATENCY_BUCKETS ? bucket : detail::LATENCY_BUCKETS - 1;
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Live counters of one worker. Only the owner writes them (threads outside the pool share one extra set), stats()
+    // reads them concurrently, hence relaxed atomics padded away from the neighbouring worker's.
+    struct WorkerCounters
+    {
+        std::atomic<uint64_t> tasks_executed;
+        std::atomic<uint64_t> steals_attempted;
+        std::atomic<uint64_t> steals_succeeded;
+        std::atomic<uint64_t> busy_ns;
+        std::atomic<uint64_t> idle_ns;
+        std::atomic<uint64_t> parked_ns;
+        std::atomic<uint64_t> wakeups;
+        std::atomic<uint64_t> max_queue_depth;
+        std::atomic<uint64_t> wait_latency[detail::LATENCY_BUCKETS];
+        std::atomic<uint64_t> run_latency[detail::LATENCY_BUCKETS];
+        char                  padding[detail::CACHE_LINE_SIZE];
+
+        WorkerCounters() : tasks_executed(0), steals_attempted(0), steals_succeeded(0), busy_ns(0), idle_ns(0), parked_ns(0), wakeups(0), max_queue_depth(0)
+        {
+            for (uint32_t i = 0; i < detail::LATENCY_BUCKETS; i++)
+            {
+                wait_latency[i].store(0, std::memory_order_relaxed);
+                run_latency[i].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        static inline void add(std::atomic<uint64_t>& counter, uint64_t value)
+        {
+            counter.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        static inline void raise(std::atomic<uint64_t>& counter, uint64_t value)
+        {
+            uint64_t current = counter.load(std::memory_order_relaxed);
+
+            while (value > current && !counter.compare_exchange_weak(current, value, std::memory_order_relaxed))
+                ;
+        }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    enum TraceEventType
+    {
+        TRACE_TASK_BEGIN = 1,
+        TRACE_TASK_END,
+        TRACE_ENQUEUE,
+        TRACE_STEAL,
+        TRACE_PARK,
+        TRACE_UNPARK,
+        TRACE_RELEASE
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Every field is a relaxed atomic so dump_trace() can read slots while they are being overwritten. sequence works
+    // like a seqlock: odd while the slot is written, slot number * 2 + 2 once it is complete.
+    struct TraceEvent
+    {
+        std::atomic<uint64_t> sequence;
+        std::atomic<uint64_t> time;
+        std::atomic<uint64_t> task;   // Task id, see trace_id().
+        std::atomic<uint64_t> other;  // Name for TRACE_TASK_BEGIN, successor id for TRACE_RELEASE, victim for TRACE_STEAL.
+        std::atomic<uint64_t> thread; // Type in the upper 32 bits, thread tag in the lower.
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Fixed size ring that keeps the last SIZE events. Slots are claimed with a fetch_add so threads outside the
+    // pool can share one buffer.
+    template <uint32_t SIZE>
+    struct TraceBuffer
+    {
+        std::unique_ptr<TraceEvent[]> m_events;
+        std::atomic<uint64_t>         m_head;
+        char                          m_padding[detail::CACHE_LINE_SIZE];
+
+        TraceBuffer() : m_events(new TraceEvent[SIZE]), m_head(0)
+        {
+            for (uint32_t i = 0; i < SIZE; i++)
+                m_events[i].sequence.store(0, std::memory_order_relaxed);
+        }
+
+        inline void record(uint32_t type, uint32_t thread, uint64_t task, uint64_t other)
+        {
+            const uint64_t slot = m_head.fetch_add(1, std::memory_order_relaxed);
+            TraceEvent&    event = m_events[slot % SIZE];
+
+            event.sequence.store(slot * 2 + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            event.time.store(now_ns(), std::memory_order_relaxed);
+            event.task.store(task, std::memory_order_relaxed);
+            event.other.store(other, std::memory_order_relaxed);
+            event.thread.store((uint64_t(type) << 32) | thread, std::memory_order_relaxed);
+            event.sequence.store(slot * 2 + 2, std::memory_order_release);
+        }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Identifies one execution of a task: the address plus the low bits of the generation in the unused top bits.
+    template <typename Traits>
+    inline uint64_t trace_id(BasicTask<Traits>* task)
+    {
+        return uint64_t(uintptr_t(task)) ^ (uint64_t(task->generation.load(std::memory_order_relaxed) & 0xFFFFu) << 48);
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Workers are tagged with their index, threads outside the pool get 0x80000000 | n in order of first use.
+    inline uint32_t external_trace_tag()
+    {
+        static std::atomic<uint32_t> next_tag(0);
+        static thread_local uint32_t tag = 0x80000000u | next_tag.fetch_add(1, std::memory_order_relaxed);
+        return tag;
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline void write_json_string(FILE* file, const char* text)
+    {
+        fputc('"', file);
+
+        for (; *text; text++)
+        {
+            if (*text == '"' || *text == '\\')
+                fprintf(file, "\\%c", *text);
+            else if (uint8_t(*text) < 0x20)
+                fprintf(file, "\\u%04x", uint32_t(uint8_t(*text)));
+            else
+                fputc(*text, file);
+        }
+
+        fputc('"', file);
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline void* aligned_malloc(size_t size, size_t alignment)
+    {
+#if defined(_MSC_VER)
+        return _aligned_malloc(size, alignment);
+#else
+        void* ptr = nullptr;
+        return posix_memalign(&ptr, alignment, size) == 0 ? ptr : nullptr;
+#endif
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline void aligned_free(void* ptr)
+    {
+#if defined(_MSC_VER)
+        _aligned_free(ptr);
+#else
+        ::free(ptr);
+#endif
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // How workers are bound to CPUs. Pinning is only implemented on Linux, elsewhere workers are left to the OS.
+    enum class WorkerAffinity : uint8_t
+    {
+        NONE, // Let the OS place workers anywhere.
+        CORE, // One worker per logical CPU, filling physical cores before SMT siblings.
+        NODE  // Each worker may run on any CPU of one NUMA node.
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    struct CpuInfo
+    {
+        uint32_t cpu;      // OS index of the logical CPU.
+        uint32_t core;     // Dense physical core index, SMT siblings share it.
+        uint32_t node;     // Dense NUMA node index.
+        uint32_t l2;       // Lowest CPU sharing our L2, so equal values mean a shared cache.
+        uint32_t l3;       // Same for the L3.
+        uint32_t smt_rank; // 0 for the first hardware thread of a core.
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Usable CPUs in placement order: first hardware thread of every core (grouped by node), then the siblings.
+    struct CpuTopology
+    {
+        std::vector<CpuInfo> cpus;
+        uint32_t             num_cores;
+        uint32_t             num_nodes;
+
+        CpuTopology() : num_cores(0), num_nodes(0) {}
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+#if defined(__linux__)
+    // Reads a small sysfs file into buffer, returns false if it doesn't exist.
+    inline bool read_sysfs(const char* path, char* buffer, size_t size)
+    {
+        FILE* file = fopen(path, "r");
+
+        if (!file)
+            return false;
+
+        const size_t length = fread(buffer, 1, size - 1, file);
+        fclose(file);
+        buffer[length] = '\0';
+
+        return length > 0;
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Parses kernel CPU lists like "0-3,8,10-11".
+    inline void parse_cpu_list(const char* text, std::vector<uint32_t>& out)
+    {
+        while (*text)
+        {
+            char*               end = nullptr;
+            const unsigned long first = strtoul(text, &end, 10);
+
+            if (end == text)
+                break;
+
+            unsigned long last = first;
+            text = end;
+
+            if (*text == '-')
+            {
+                last = strtoul(text + 1, &end, 10);
+                text = end;
+            }
+
+            for (unsigned long i = first; i <= last; i++)
+                out.push_back(uint32_t(i));
+
+            while (*text == ',' || *text == '\n' || *text == ' ')
+                text++;
+        }
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline uint32_t read_sysfs_first_cpu(const char* path, uint32_t fallback)
+    {
+        char                  buffer[4096];
+        std::vector<uint32_t> cpus;
+
+        if (read_sysfs(path, buffer, sizeof(buffer)))
+            parse_cpu_list(buffer, cpus);
+
+        return cpus.empty() ? fallback : cpus[0];
+    }
+#endif
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Probes /sys/devices/system/{cpu,node} on Linux, limited to the CPUs the process may run on. Anywhere else (or if
+    // sysfs isn't there) every logical CPU is reported as its own core on a single node sharing one L3.
+    inline CpuTopology probe_cpu_topology()
+    {
+        CpuTopology topology;
+
+#if defined(__linux__)
+        char                  buffer[4096];
+        char                  path[256];
+        std::vector<uint32_t> online;
+        std::vector<uint32_t> node_ids;
+        cpu_set_t             allowed;
+
+        if (read_sysfs("/sys/devices/system/cpu/online", buffer, sizeof(buffer)))
+            parse_cpu_list(buffer, online);
+
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+            CPU_ZERO(&allowed);
+
+        if (read_sysfs("/sys/devices/system/node/online", buffer, sizeof(buffer)))
+            parse_cpu_list(buffer, node_ids);
+
+        std::vector<uint64_t> core_keys;
+
+        for (size_t i = 0; i < online.size(); i++)
+        {
+            const uint32_t cpu = online[i];
+
+            if (cpu < CPU_SETSIZE && CPU_COUNT(&allowed) && !CPU_ISSET(cpu, &allowed))
+                continue;
+
+            CpuInfo info = { cpu, 0, 0, cpu, 0xFFFFFFFFu, 0 };
+
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", cpu);
+            const uint64_t package = read_sysfs(path, buffer, sizeof(buffer)) ? strtoull(buffer, nullptr, 10) : 0;
+
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/core_id", cpu);
+            const uint64_t core_id = read_sysfs(path, buffer, sizeof(buffer)) ? strtoull(buffer, nullptr, 10) : cpu;
+            const uint64_t core_key = (package << 32) | core_id;
+
+            info.core = uint32_t(std::find(core_keys.begin(), core_keys.end(), core_key) - core_keys.begin());
+
+            if (info.core == core_keys.size())
+                core_keys.push_back(core_key);
+
+            // Unified and data caches only, the instruction cache says nothing about data sharing.
+            for (uint32_t index = 0; index < 8; index++)
+            {
+                snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cache/index%u/type", cpu, index);
+
+                if (!read_sysfs(path, buffer, sizeof(buffer)))
+                    break;
+
+                if (strncmp(buffer, "Instruction", 11) == 0)
+                    continue;
+
+                snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cache/index%u/level", cpu, index);
+                const uint32_t level = read_sysfs(path, buffer, sizeof(buffer)) ? uint32_t(strtoul(buffer, nullptr, 10)) : 0;
+
+                snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cache/index%u/shared_cpu_list", cpu, index);
+
+                if (level == 2)
+                    info.l2 = read_sysfs_first_cpu(path, cpu);
+                else if (level == 3)
+                    info.l3 = read_sysfs_first_cpu(path, cpu);
+            }
+
+            // Without an L3 the package is the next best thing.
+            if (info.l3 == 0xFFFFFFFFu)
+                info.l3 = 0x80000000u | uint32_t(package);
+
+            topology.cpus.push_back(info);
+        }
+
+        for (size_t i = 0; i < node_ids.size(); i++)
+        {
+            std::vector<uint32_t> node_cpus;
+
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node_ids[i]);
+
+            if (read_sysfs(path, buffer, sizeof(buffer)))
+                parse_cpu_list(buffer, node_cpus);
+
+            for (size_t j = 0; j < topology.cpus.size(); j++)
+            {
+                if (std::find(node_cpus.begin(), node_cpus.end(), topology.cpus[j].cpu) != node_cpus.end())
+                    topology.cpus[j].node = uint32_t(i);
+            }
+        }
+
+        topology.num_cores = uint32_t(core_keys.size());
+        topology.num_nodes = node_ids.empty() ? 1 : uint32_t(node_ids.size());
+#endif
+
+        if (topology.cpus.empty())
+        {
+            const uint32_t num_cpus = std::max(std::thread::hardware_concurrency(), 1u);
+
+            for (uint32_t i = 0; i < num_cpus; i++)
+            {
+                CpuInfo info = { i, i, 0, i, 0, 0 };
+                topology.cpus.push_back(info);
+            }
+
+            topology.num_cores = num_cpus;
+            topology.num_nodes = 1;
+        }
+
+        for (size_t i = 0; i < topology.cpus.size(); i++)
+        {
+            for (size_t j = 0; j < i; j++)
+            {
+                if (topology.cpus[j].core == topology.cpus[i].core)
+                    topology.cpus[i].smt_rank++;
+            }
+        }
+
+        std::stable_sort(topology.cpus.begin(), topology.cpus.end(), [](const CpuInfo& a, const CpuInfo& b) {
+            if (a.smt_rank != b.smt_rank)
+                return a.smt_rank < b.smt_rank;
+
+            return a.node < b.node;
+        });
+
+        return topology;
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Binds the calling thread to the CPU described by info, or to its whole node. No-op where unsupported.
+    inline void pin_current_thread(const CpuTopology& topology, const CpuInfo& info, WorkerAffinity affinity)
+    {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+
+        for (size_t i = 0; i < topology.cpus.size(); i++)
+        {
+            const CpuInfo& cpu = topology.cpus[i];
+
+            if (cpu.cpu < CPU_SETSIZE && (affinity == WorkerAffinity::NODE ? cpu.node == info.node : cpu.cpu == info.cpu))
+                CPU_SET(cpu.cpu, &set);
+        }
+
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        (void)topology;
+        (void)info;
+        (void)affinity;
+#endif
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Hands out objects from up to MAX_SLABS slabs of SLAB_SIZE that are allocated on demand and never released
+    // until the pool goes away. Free slots live on a lock-free global stack, with a small cache in front of it per worker
+    // so the common allocate/free path never leaves the owning thread. T needs an index and an atomic next_free.
+    template <typename T, uint32_t SLAB_SIZE, uint32_t MAX_SLABS>
+    struct SlabAllocator
+    {
+        struct Cache
+        {
+            uint32_t m_free[detail::TASK_CACHE_SIZE];
+            uint32_t m_count;
+            char     m_padding[detail::CACHE_LINE_SIZE];
+        };
+
+        std::atomic<T*>          m_slabs[MAX_SLABS];
+        std::atomic<uint32_t>    m_num_slabs;
+        std::atomic<uint64_t>    m_free_head;
+        std::mutex               m_grow_mutex;
+        std::unique_ptr<Cache[]> m_caches;
+        uint32_t                 m_num_caches;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        SlabAllocator()
+        {
+            m_num_slabs = 0;
+            m_free_head = pack(0, detail::INVALID_TASK_INDEX);
+            m_num_caches = 0;
+
+            for (uint32_t i = 0; i < MAX_SLABS; i++)
+                m_slabs[i].store(nullptr, std::memory_order_relaxed);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        ~SlabAllocator()
+        {
+            for (uint32_t i = 0; i < m_num_slabs; i++)
+            {
+                T* slab = m_slabs[i].load(std::memory_order_relaxed);
+
+                for (uint32_t j = 0; j < SLAB_SIZE; j++)
+                    slab[j].~T();
+
+                aligned_free(slab);
+            }
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        void initialize(uint32_t num_workers)
+        {
+            m_num_caches = num_workers;
+            m_caches.reset(new Cache[num_workers]);
+
+            for (uint32_t i = 0; i < num_workers; i++)
+                m_caches[i].m_count = 0;
+
+            // Allocate the first slab up front so the first frame doesn't pay for it.
+            grow();
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Returns nullptr once MAX_SLABS * SLAB_SIZE objects are alive at the same time.
+        T* allocate(uint32_t worker_index)
+        {
+            if (worker_index < m_num_caches)
+            {
+                Cache& cache = m_caches[worker_index];
+
+                if (cache.m_count == 0)
+                {
+                    // Refill half the cache from the shared stack.
+                    while (cache.m_count < detail::TASK_CACHE_SIZE / 2)
+                    {
+                        T* object = pop_free();
+
+                        if (!object)
+                            break;
+
+                        cache.m_free[cache.m_count++] = object->index;
+                    }
+
+                    if (cache.m_count == 0)
+                        return pop_or_grow();
+                }
+
+                return get(cache.m_free[--cache.m_count]);
+            }
+
+            return pop_or_grow();
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Fills objects with up to count objects and returns how many it got. Drains the worker cache first and then
+        // takes whole runs off the shared stack with one CAS each.
+        uint32_t allocate_batch(T** objects, uint32_t count, uint32_t worker_index)
+        {
+            uint32_t num_allocated = 0;
+
+            if (worker_index < m_num_caches)
+            {
+                Cache& cache = m_caches[worker_index];
+
+                while (num_allocated < count && cache.m_count > 0)
+                    objects[num_allocated++] = get(cache.m_free[--cache.m_count]);
+            }
+
+            while (num_allocated < count)
+            {
+                const uint32_t num_popped = pop_free_batch(objects + num_allocated, count - num_allocated);
+
+                if (num_popped == 0 && !grow())
+                    break;
+
+                num_allocated += num_popped;
+            }
+
+            return num_allocated;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        void free(T* object, uint32_t worker_index)
+        {
+            if (worker_index < m_num_caches)
+            {
+                Cache& cache = m_caches[worker_index];
+
+                // Spill half the cache back to the shared stack so other threads can pick it up.
+                if (cache.m_count == detail::TASK_CACHE_SIZE)
+                {
+                    while (cache.m_count > detail::TASK_CACHE_SIZE / 2)
+                        push_free(get(cache.m_free[--cache.m_count]));
+                }
+
+                cache.m_free[cache.m_count++] = object->index;
+            }
+            else
+                push_free(object);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline T* get(uint32_t index)
+        {
+            return &m_slabs[index / SLAB_SIZE].load(std::memory_order_acquire)[index % SLAB_SIZE];
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline bool is_valid(uint32_t index)
+        {
+            return index != detail::INVALID_TASK_INDEX && index / SLAB_SIZE < m_num_slabs.load(std::memory_order_acquire);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    private:
+
+        // The free list head packs an ABA tag into the upper 32 bits and the slot index into the lower 32.
+        static inline uint64_t pack(uint32_t tag, uint32_t index)
+        {
+            return (uint64_t(tag) << 32) | index;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        void push_free(T* object)
+        {
+            uint64_t head = m_free_head.load(std::memory_order_relaxed);
+
+            do
+            {
+                object->next_free.store(uint32_t(head), std::memory_order_relaxed);
+            } while (!m_free_head.compare_exchange_weak(head, pack(uint32_t(head >> 32) + 1, object->index), std::memory_order_release, std::memory_order_relaxed));
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        T* pop_free()
+        {
+            uint64_t head = m_free_head.load(std::memory_order_acquire);
+
+            while (uint32_t(head) != detail::INVALID_TASK_INDEX)
+            {
+                T*             object = get(uint32_t(head));
+                const uint32_t next = object->next_free.load(std::memory_order_relaxed);
+
+                if (m_free_head.compare_exchange_weak(head, pack(uint32_t(head >> 32) + 1, next), std::memory_order_acquire, std::memory_order_acquire))
+                    return object;
+            }
+
+            return nullptr;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Detaches up to count objects from the top of the stack at once. Slabs are never released, so walking the
+        // chain is always safe, and the tag makes the CAS fail if anything was pushed or popped in the meantime.
+        uint32_t pop_free_batch(T** objects, uint32_t count)
+        {
+            uint64_t head = m_free_head.load(std::memory_order_acquire);
+
+            while (uint32_t(head) != detail::INVALID_TASK_INDEX)
+            {
+                uint32_t num_popped = 0;
+                uint32_t next = uint32_t(head);
+
+                while (num_popped < count && next != detail::INVALID_TASK_INDEX)
+                {
+                    objects[num_popped] = get(next);
+                    next = objects[num_popped++]->next_free.load(std::memory_order_relaxed);
+                }
+
+                if (m_free_head.compare_exchange_weak(head, pack(uint32_t(head >> 32) + 1, next), std::memory_order_acquire, std::memory_order_acquire))
+                    return num_popped;
+            }
+
+            return 0;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        T* pop_or_grow()
+        {
+            T* object = pop_free();
+
+            while (!object)
+            {
+                if (!grow())
+                    return nullptr;
+
+                object = pop_free();
+            }
+
+            return object;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        bool grow()
+        {
+            std::lock_guard<std::mutex> lock(m_grow_mutex);
+
+            // Somebody else may have grown the pool while we were waiting for the lock.
+            if (uint32_t(m_free_head.load(std::memory_order_acquire)) != detail::INVALID_TASK_INDEX)
+                return true;
+
+            const uint32_t slab_index = m_num_slabs.load(std::memory_order_relaxed);
+
+            if (slab_index == MAX_SLABS)
+                return false;
+
+            T* slab = static_cast<T*>(aligned_malloc(sizeof(T) * SLAB_SIZE, alignof(T) < detail::CACHE_LINE_SIZE ? detail::CACHE_LINE_SIZE : alignof(T)));
+
+            if (!slab)
+                return false;
+
+            for (uint32_t i = 0; i < SLAB_SIZE; i++)
+            {
+                new (&slab[i]) T();
+                slab[i].index = slab_index * SLAB_SIZE + i;
+            }
+
+            m_slabs[slab_index].store(slab, std::memory_order_release);
+            m_num_slabs.store(slab_index + 1, std::memory_order_release);
+
+            // Push in reverse so allocations walk the slab front to back.
+            for (uint32_t i = SLAB_SIZE; i > 0; i--)
+                push_free(&slab[i - 1]);
+
+            return true;
+        }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    template <typename Deque>
+    struct WorkerThread
+    {
+        Deque                 m_deques[detail::NUM_TASK_PRIORITIES];
+        std::thread           m_thread;
+        std::atomic<bool>     m_active;                        // Slot has a running thread, retired slots are skipped by thieves.
+        uint32_t              m_cpu;                           // Index into the pool's CpuTopology::cpus.
+        uint32_t              m_numa_node;
+        std::vector<uint32_t> m_victims;                       // Every other worker, nearest first.
+        uint32_t              m_victim_tiers[detail::NUM_STEAL_TIERS]; // End of each distance tier in m_victims.
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+		WorkerThread() : m_active(false), m_cpu(0), m_numa_node(0) {}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        ~WorkerThread()
+        {
+            if (m_thread.joinable())
+                m_thread.join();
+        }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // A set of tasks and the edges between them that is built and validated once, then launched as many times as
+    // needed with ThreadPool::run(). Launching only resets one counter per node and pushes the root nodes.
+    template <typename Traits>
+    class BasicTaskGraph
+    {
+    public:
+        typedef BasicTask<Traits>      Task;
+        typedef BasicTaskEdges<Traits> TaskEdges;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        BasicTaskGraph() : m_tasks(nullptr), m_num_tasks(0), m_num_remaining(0), m_compiled(false) {}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        ~BasicTaskGraph()
+        {
+            release_compiled();
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Returns the id of the new node.
+        inline uint32_t add_node(TaskFunction function)
+        {
+            Node node;
+            node.function = function;
+            node.priority = TaskPriority::NORMAL;
+            node.numa_node = INVALID_NUMA_NODE;
+            node.name = nullptr;
+            m_nodes.push_back(node);
+            m_compiled = false;
+
+            return uint32_t(m_nodes.size() - 1);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // The callable is stored in the node data and invoked on every run, so it has to be trivially copyable
+        // (capture pointers or plain values, not containers).
+        template <typename F>
+        inline uint32_t add_node(F&& callable)
+        {
+            typedef typename std::decay<F>::type Callable;
+
+            static_assert(sizeof(Callable) <= Traits::TASK_SIZE_BYTES, "Callable does not fit in Traits::TASK_SIZE_BYTES");
+            static_assert(alignof(Callable) <= 16, "Callable is over-aligned for the task data");
+            static_assert(std::is_trivially_copyable<Callable>::value, "Graph node callables have to be trivially copyable");
+
+            const uint32_t node = add_node(&invoke_node_callable<Callable>);
+            new (m_nodes[node].data) Callable(std::forward<F>(callable));
+
+            return node;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Makes after wait for before. Returns false for invalid ids or self edges; capacity is checked by compile().
+        inline bool precede(uint32_t before, uint32_t after)
+        {
+            if (before >= m_nodes.size() || after >= m_nodes.size() || before == after)
+                return false;
+
+            m_edges.push_back(std::make_pair(before, after));
+            m_compiled = false;
+
+            return true;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline void set_priority(uint32_t node, TaskPriority priority)
+        {
+            m_nodes[node].priority = priority;
+            m_compiled = false;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // See ThreadPool::set_name().
+        inline void set_name(uint32_t node, const char* name)
+        {
+            m_nodes[node].name = name;
+            m_compiled = false;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // See ThreadPool::set_numa_node().
+        inline void set_numa_node(uint32_t node, uint32_t numa_node)
+        {
+            m_nodes[node].numa_node = numa_node < INVALID_NUMA_NODE ? uint8_t(numa_node) : uint8_t(INVALID_NUMA_NODE);
+            m_compiled = false;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Payload of a node. Before compile() it points into the build storage, afterwards into the compiled task,
+        // which is where per-run patches have to go.
+        template <typename T>
+        inline T* node_data(uint32_t node)
+        {
+            if (m_compiled)
+                return reinterpret_cast<T*>(&m_tasks[m_positions[node]].data[0]);
+            else
+                return reinterpret_cast<T*>(&m_nodes[node].data[0]);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Validates the graph (no cycles, at most TaskEdges::MAX_SUCCESSORS outgoing edges per node) and flattens it into a
+        // topologically sorted task array. Returns false if the graph is invalid.
+        inline bool compile()
+        {
+            release_compiled();
+
+            const uint32_t        num_nodes = uint32_t(m_nodes.size());
+            std::vector<uint32_t> in_degree(num_nodes, 0);
+            std::vector<uint32_t> out_degree(num_nodes, 0);
+            std::vector<uint32_t> offsets(num_nodes + 1, 0);
+            std::vector<uint32_t> adjacency(m_edges.size());
+
+            for (size_t i = 0; i < m_edges.size(); i++)
+            {
+                out_degree[m_edges[i].first]++;
+                in_degree[m_edges[i].second]++;
+            }
+
+            for (uint32_t i = 0; i < num_nodes; i++)
+            {
+                if (out_degree[i] > TaskEdges::MAX_SUCCESSORS)
+                    return false;
+
+                offsets[i + 1] = offsets[i] + out_degree[i];
+            }
+
+            std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+
+            for (size_t i = 0; i < m_edges.size(); i++)
+                adjacency[cursor[m_edges[i].first]++] = m_edges[i].second;
+
+            // Kahn's algorithm. Anything left over is part of a cycle.
+            std::vector<uint32_t> order;
+            std::vector<uint32_t> remaining(in_degree);
+            order.reserve(num_nodes);
+
+            for (uint32_t i = 0; i < num_nodes; i++)
+            {
+                if (remaining[i] == 0)
+                    order.push_back(i);
+            }
+
+            for (size_t i = 0; i < order.size(); i++)
+            {
+                for (uint32_t j = offsets[order[i]]; j < offsets[order[i] + 1]; j++)
+                {
+                    if (--remaining[adjacency[j]] == 0)
+                        order.push_back(adjacency[j]);
+                }
+            }
+
+            if (order.size() != num_nodes)
+                return false;
+
+            m_positions.resize(num_nodes);
+
+            for (uint32_t i = 0; i < num_nodes; i++)
+                m_positions[order[i]] = i;
+
+            m_num_tasks = num_nodes;
+            m_tasks = static_cast<Task*>(aligned_malloc(sizeof(Task) * (num_nodes ? num_nodes : 1), detail::CACHE_LINE_SIZE));
+
+            if (!m_tasks)
+                return false;
+
+            m_edge_blocks.reset(new TaskEdges[num_nodes]);
+            m_initial_predecessors.resize(num_nodes);
+            m_roots.clear();
+
+            for (uint32_t i = 0; i < num_nodes; i++)
+            {
+                const uint32_t node = order[i];
+                Task*          task = new (&m_tasks[i]) Task();
+
+                task->function = m_nodes[node].function;
+                task->priority = m_nodes[node].priority;
+                task->numa_node = m_nodes[node].numa_node;
+                task->name.set(m_nodes[node].name);
+                task->counter = &m_num_remaining;
+                task->flags = detail::TASK_FLAG_STATIC;
+                memcpy(task->data, m_nodes[node].data, Traits::TASK_SIZE_BYTES);
+
+                TaskEdges& task_edges = m_edge_blocks[i];
+
+                for (uint32_t j = offsets[node]; j < offsets[node + 1]; j++)
+                    task_edges.successors[task_edges.num_successors++] = &m_tasks[m_positions[adjacency[j]]];
+
+                task->edges = task_edges.num_successors > 0 ? &task_edges : nullptr;
+
+                // Roots have nothing to wait for, run() pushes all of them in one batch.
+                m_initial_predecessors[i] = in_degree[node];
+
+                if (in_degree[node] == 0)
+                    m_roots.push_back(task);
+            }
+
+            m_compiled = true;
+
+            return true;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline bool is_compiled() const
+        {
+            return m_compiled;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline bool is_done() const
+        {
+            return m_num_remaining.load(std::memory_order_acquire) == 0;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline uint32_t num_nodes() const
+        {
+            return uint32_t(m_nodes.size());
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    private:
+        template <typename>
+        friend class BasicThreadPool;
+
+        struct Node
+        {
+            TaskFunction     function;
+            TaskPriority     priority;
+            uint8_t          numa_node;
+            const char*      name;
+            alignas(16) char data[Traits::TASK_SIZE_BYTES];
+        };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        BasicTaskGraph(const BasicTaskGraph&);
+        BasicTaskGraph& operator=(const BasicTaskGraph&);
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        template <typename Callable>
+        static void invoke_node_callable(void* data)
+        {
+            (*static_cast<Callable*>(data))();
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline void release_compiled()
+        {
+            if (m_tasks)
+            {
+                for (uint32_t i = 0; i < m_num_tasks; i++)
+                    m_tasks[i].~Task();
+
+                aligned_free(m_tasks);
+            }
+
+            m_tasks = nullptr;
+            m_num_tasks = 0;
+            m_edge_blocks.reset();
+            m_compiled = false;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        std::vector<Node>                            m_nodes;
+        std::vector<std::pair<uint32_t, uint32_t> >  m_edges;
+        Task*                                        m_tasks;
+        uint32_t                                     m_num_tasks;
+        std::unique_ptr<TaskEdges[]>                 m_edge_blocks;
+        std::vector<uint32_t>                        m_initial_predecessors;
+        std::vector<uint32_t>                        m_positions;
+        std::vector<Task*>                           m_roots;
+        std::atomic<uint32_t>                        m_num_remaining;
+        bool                                         m_compiled;
+    };
+
+    typedef BasicTaskGraph<DefaultThreadPoolTraits> TaskGraph;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Size-class allocator for small, short lived blocks such as coroutine frames. Blocks from FRAME_MIN_BLOCK_SIZE
+    // up to FRAME_MIN_BLOCK_SIZE << (FRAME_SIZE_CLASSES - 1) bytes are carved out of chunks that are kept until the
+    // pool goes away, anything larger goes straight to operator new. Workers keep a small cache per size class.
+    struct FrameAllocator
+    {
+        struct FreeBlock
+        {
+            FreeBlock* next;
+        };
+
+        struct SizeClass
+        {
+            std::mutex m_mutex;
+            FreeBlock* m_head;
+        };
+
+        struct Cache
+        {
+            FreeBlock* m_heads[detail::FRAME_SIZE_CLASSES];
+            uint32_t   m_counts[detail::FRAME_SIZE_CLASSES];
+            char       m_padding[detail::CACHE_LINE_SIZE];
+        };
+
+        SizeClass                m_classes[detail::FRAME_SIZE_CLASSES];
+        std::mutex               m_chunk_mutex;
+        std::vector<void*>       m_chunks;
+        std::unique_ptr<Cache[]> m_caches;
+        uint32_t                 m_num_caches;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        FrameAllocator()
+        {
+            m_num_caches = 0;
+
+            for (uint32_t i = 0; i < detail::FRAME_SIZE_CLASSES; i++)
+                m_classes[i].m_head = nullptr;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        ~FrameAllocator()
+        {
+            for (size_t i = 0; i < m_chunks.size(); i++)
+                aligned_free(m_chunks[i]);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        void initialize(uint32_t num_workers)
+        {
+            m_num_caches = num_workers;
+            m_caches.reset(new Cache[num_workers]);
+
+            for (uint32_t i = 0; i < num_workers; i++)
+            {
+                for (uint32_t j = 0; j < detail::FRAME_SIZE_CLASSES; j++)
+                {
+                    m_caches[i].m_heads[j] = nullptr;
+                    m_caches[i].m_counts[j] = 0;
+                }
+            }
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        void* allocate(size_t size, uint32_t worker_index)
+        {
+            const uint32_t size_class = size_class_of(size);
+
+            if (size_class == detail::FRAME_SIZE_CLASSES)
+                return ::operator new(size);
+
+            if (worker_index < m_num_caches)
+            {
+                Cache& cache = m_caches[worker_index];
+
+                if (cache.m_heads[size_class])
+                {
+                    FreeBlock* block = cache.m_heads[size_class];
+                    cache.m_heads[size_class] = block->next;
+                    cache.m_counts[size_class]--;
+                    return block;
+                }
+            }
+
+            SizeClass& shared = m_classes[size_class];
+
+            {
+                std::lock_guard<std::mutex> lock(shared.m_mutex);
+
+                if (shared.m_head)
+                {
+                    FreeBlock* block = shared.m_head;
+                    shared.m_head = block->next;
+                    return block;
+                }
+            }
+
+            return carve(size_class);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // size has to be the size that was passed to allocate().
+        void free(void* ptr, size_t size, uint32_t worker_index)
+        {
+            const uint32_t size_class = size_class_of(size);
+
+            if (size_class == detail::FRAME_SIZE_CLASSES)
+            {
+                ::operator delete(ptr);
+                return;
+            }
+
+            FreeBlock* block = static_cast<FreeBlock*>(ptr);
+
+            if (worker_index < m_num_caches)
+            {
+                Cache& cache = m_caches[worker_index];
+
+                if (cache.m_counts[size_class] < detail::FRAME_CACHE_SIZE)
+                {
+                    block->next = cache.m_heads[size_class];
+                    cache.m_heads[size_class] = block;
+                    cache.m_counts[size_class]++;
+                    return;
+                }
+            }
+
+            SizeClass&                  shared = m_classes[size_class];
+            std::lock_guard<std::mutex> lock(shared.m_mutex);
+
+            block->next = shared.m_head;
+            shared.m_head = block;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    private:
+
+        static inline uint32_t size_class_of(size_t size)
+        {
+            uint32_t size_class = 0;
+            size_t   block_size = detail::FRAME_MIN_BLOCK_SIZE;
+
+            while (block_size < size && size_class < detail::FRAME_SIZE_CLASSES)
+            {
+                block_size <<= 1;
+                size_class++;
+            }
+
+            return size_class;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Cuts a fresh chunk into blocks of the given class, returns one and puts the rest on the shared list.
+        void* carve(uint32_t size_class)
+        {
+            const size_t block_size = size_t(detail::FRAME_MIN_BLOCK_SIZE) << size_class;
+            char*        chunk = nullptr;
+
+            {
+                std::lock_guard<std::mutex> lock(m_chunk_mutex);
+                chunk = static_cast<char*>(aligned_malloc(detail::FRAME_CHUNK_SIZE, detail::CACHE_LINE_SIZE));
+
+                if (!chunk)
+                    return nullptr;
+
+                m_chunks.push_back(chunk);
+            }
+
+            const size_t num_blocks = detail::FRAME_CHUNK_SIZE / block_size;
+            SizeClass&   shared = m_classes[size_class];
+
+            std::lock_guard<std::mutex> lock(shared.m_mutex);
+
+            for (size_t i = 1; i < num_blocks; i++)
+            {
+                FreeBlock* block = reinterpret_cast<FreeBlock*>(chunk + i * block_size);
+                block->next = shared.m_head;
+                shared.m_head = block;
+            }
+
+            return chunk;
+        }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Bump pointer allocator behind ThreadPool::frame_alloc(). Blocks of ARENA_BLOCK_SIZE bytes are kept across
+    // resets, so once warmed up a frame doesn't allocate at all. Anything that doesn't fit in a block gets a block
+    // of its own, freed at the next reset. Resetting is lazy: the arena compares the pool's epoch on the next
+    // allocation and just rewinds, so the pool can reset every arena in O(1).
+    struct LinearArena
+    {
+#if THREAD_POOL_ARENA_CHECKS
+        // Precedes every allocation so stale pointers can be told apart from live ones.
+        struct Header
+        {
+            uint32_t magic;
+            uint32_t epoch;
+            char     padding[8];
+        };
+#endif
+
+        std::vector<char*> m_blocks;
+        std::vector<void*> m_large;
+        char*              m_current;
+        size_t             m_offset;
+        uint32_t           m_next_block;
+        uint32_t           m_epoch;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        LinearArena() : m_current(nullptr), m_offset(0), m_next_block(0), m_epoch(0) {}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        ~LinearArena()
+        {
+            free_large();
+
+            for (size_t i = 0; i < m_blocks.size(); i++)
+                aligned_free(m_blocks[i]);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // alignment has to be a power of two. Returns nullptr if the system is out of memory.
+        void* allocate(size_t size, size_t alignment, uint32_t epoch)
+        {
+            if (epoch != m_epoch)
+                reset(epoch);
+
+#if THREAD_POOL_ARENA_CHECKS
+            // The header goes right in front of the allocation, a whole alignment step keeps the allocation aligned.
+            alignment = std::max(alignment, sizeof(Header));
+            size += alignment;
+#endif
+
+            char* ptr = bump(size, alignment);
+
+            if (!ptr)
+                return nullptr;
+
+#if THREAD_POOL_ARENA_CHECKS
+            ptr += alignment;
+
+            Header* header = reinterpret_cast<Header*>(ptr) - 1;
+            header->magic = detail::ARENA_ALLOCATION_MAGIC;
+            header->epoch = epoch;
+#endif
+
+            return ptr;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Rewinds to the first block. With checks on, everything handed out so far is overwritten with ARENA_POISON.
+        void reset(uint32_t epoch)
+        {
+#if THREAD_POOL_ARENA_CHECKS
+            for (uint32_t i = 0; i < m_next_block; i++)
+                memset(m_blocks[i], detail::ARENA_POISON, m_blocks[i] == m_current ? m_offset : detail::ARENA_BLOCK_SIZE);
+#endif
+
+            free_large();
+
+            m_current = nullptr;
+            m_offset = 0;
+            m_next_block = 0;
+            m_epoch = epoch;
+        }
+
+#if THREAD_POOL_ARENA_CHECKS
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        static inline bool is_live(const void* ptr, uint32_t epoch)
+        {
+            const Header* header = static_cast<const Header*>(ptr) - 1;
+            return header->magic == detail::ARENA_ALLOCATION_MAGIC && header->epoch == epoch;
+        }
+#endif
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    private:
+
+        char* bump(size_t size, size_t alignment)
+        {
+            if (m_current)
+            {
+                const uintptr_t address = (uintptr_t(m_current) + m_offset + alignment - 1) & ~uintptr_t(alignment - 1);
+
+                if (address + size <= uintptr_t(m_current) + detail::ARENA_BLOCK_SIZE)
+                {
+                    m_offset = address + size - uintptr_t(m_current);
+                    return reinterpret_cast<char*>(address);
+                }
+            }
+
+            if (size > detail::ARENA_BLOCK_SIZE || alignment > detail::CACHE_LINE_SIZE)
+            {
+                void* ptr = aligned_malloc(size, std::max(alignment, size_t(detail::CACHE_LINE_SIZE)));
+
+                if (ptr)
+                    m_large.push_back(ptr);
+
+                return static_cast<char*>(ptr);
+            }
+
+            if (m_next_block == m_blocks.size())
+            {
+                char* block = static_cast<char*>(aligned_malloc(detail::ARENA_BLOCK_SIZE, detail::CACHE_LINE_SIZE));
+
+                if (!block)
+                    return nullptr;
+
+                m_blocks.push_back(block);
+            }
+
+            // Blocks are cache line aligned, so the start of a fresh one is aligned enough.
+            m_current = m_blocks[m_next_block++];
+            m_offset = size;
+
+            return m_current;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        void free_large()
+        {
+            for (size_t i = 0; i < m_large.size(); i++)
+                aligned_free(m_large[i]);
+
+            m_large.clear();
+        }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Awaitable returned by ThreadPool::schedule(). Written against a generic handle type so this header doesn't need
+    // <coroutine>; it is only ever instantiated from C++20 code (see coroutine.hpp).
+    template <typename Pool>
+    struct ScheduleAwaiter
+    {
+        Pool*        pool;
+        TaskPriority priority;
+
+        inline bool await_ready() const { return false; }
+
+        template <typename Handle>
+        inline bool await_suspend(Handle handle);
+
+        inline void await_resume() const {}
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Shared state of one parallel_for()/parallel_reduce() call. Lives on the caller's stack until every range is done.
+    // num_pending is only used by parallel_for(), parallel_reduce() tracks its ranges through ReduceSlots.
+    template <typename Body>
+    struct ParallelRange
+    {
+        Body*                 body;
+        uint32_t              grain;
+        std::atomic<uint32_t> num_pending;
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Partial result of one parallel_reduce() range that was split off. Lives on the stack of the range that split it,
+    // which waits for pending to drop before joining and destroying the value.
+    template <typename T>
+    struct ReduceSlot
+    {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        std::atomic<uint32_t>                                      pending;
+
+        inline T& value() { return *reinterpret_cast<T*>(&storage); }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    template <typename F>
+    struct ParallelForBody
+    {
+        struct Partial {};
+
+        F* function;
+
+        inline Partial identity() { return Partial(); }
+
+        inline void run(uint32_t begin, uint32_t end, Partial&)
+        {
+            for (uint32_t i = begin; i < end; i++)
+                (*function)(i);
+        }
+
+        inline void combine(Partial&) {}
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    template <typename T, typename Map, typename Combine>
+    struct ParallelReduceBody
+    {
+        typedef T Partial;
+
+        const T* identity_value;
+        Map*     map;
+        Combine* combine_function;
+
+        inline Partial identity() { return *identity_value; }
+
+        inline void run(uint32_t begin, uint32_t end, Partial& partial)
+        {
+            for (uint32_t i = begin; i < end; i++)
+                partial = (*combine_function)(partial, (*map)(i));
+        }
+
+        // Folds the partial of the range right after left's into left. Called once per split, not per element.
+        inline void join(Partial& left, const Partial& right) { left = (*combine_function)(left, right); }
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The pool itself, configured at compile time through Traits (see DefaultThreadPoolTraits). Pools with
+    // different traits are independent types and can be used side by side.
+    template <typename Traits>
+    class BasicThreadPool
+    {
+        template <typename, typename>
+        friend class Future;
+
+        static_assert(Traits::QUEUE_CAPACITY != 0 && (Traits::QUEUE_CAPACITY & (Traits::QUEUE_CAPACITY - 1)) == 0, "QUEUE_CAPACITY has to be a power of two");
+        static_assert(Traits::TASK_SIZE_BYTES >= 32, "TASK_SIZE_BYTES has to hold at least a future and a small callable");
+
+    public:
+        typedef BasicTask<Traits>      Task;
+        typedef BasicTaskEdges<Traits> TaskEdges;
+        typedef BasicTaskGraph<Traits> TaskGraph;
+
+        // Per-worker deques only exist with work stealing, the other policies share one queue per priority.
+        typedef typename std::conditional<Traits::QUEUE_POLICY == QueuePolicy::WORK_STEALING, WorkStealingDeque<Traits>, NullDeque<Traits> >::type      Deque;
+        typedef typename std::conditional<Traits::QUEUE_POLICY == QueuePolicy::LOCK_FREE, LockFreeQueue<Traits>, InjectionQueue<Traits> >::type SharedQueue;
+        typedef dw::WorkerThread<Deque>                                                                                                         WorkerThread;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        BasicThreadPool()
+        {
+            m_shutdown = false;
+            m_num_pending_tasks = 0;
+            m_num_idle = 0;
+            m_affinity = WorkerAffinity::NONE;
+            m_topology = probe_cpu_topology();
+            initialize_queue_orders();
+
+            // get number of logical threads on CPU
+            m_num_logical_threads = std::thread::hardware_concurrency();
+
+            m_num_worker_threads = m_num_logical_threads;
+
+			initialize_workers(m_num_worker_threads, m_num_worker_threads);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        BasicThreadPool(uint32_t workers)
+        {
+            m_shutdown = false;
+            m_num_pending_tasks = 0;
+            m_num_idle = 0;
+            m_affinity = WorkerAffinity::NONE;
+            m_topology = probe_cpu_topology();
+            initialize_queue_orders();
+
+            // get number of logical threads on CPU
+            m_num_logical_threads = std::thread::hardware_concurrency();
+            m_num_worker_threads = std::min(workers, m_num_logical_threads);
+
+			initialize_workers(m_num_worker_threads, m_num_worker_threads);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Pins workers according to affinity. With pinned workers stealing prefers victims sharing a cache or
+        // NUMA node, and set_numa_node() hints are honoured.
+        BasicThreadPool(uint32_t workers, WorkerAffinity affinity)
+        {
+            m_shutdown = false;
+            m_num_pending_tasks = 0;
+            m_num_idle = 0;
+            m_affinity = affinity;
+            m_topology = probe_cpu_topology();
+            initialize_queue_orders();
+
+            m_num_logical_threads = uint32_t(m_topology.cpus.size());
+            m_num_worker_threads = std::min(workers, m_num_logical_threads);
+
+			initialize_workers(m_num_worker_threads, m_num_worker_threads);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Elastic pool: starts min_workers and grows up to max_workers (capped at the number of logical threads)
+        // while every worker is busy and the backlog keeps building up. Workers beyond min_workers retire after
+        // WORKER_IDLE_TIMEOUT_MS without work.
+        BasicThreadPool(uint32_t min_workers, uint32_t max_workers, WorkerAffinity affinity = WorkerAffinity::NONE)
+        {
+            m_shutdown = false;
+            m_num_pending_tasks = 0;
+            m_num_idle = 0;
+            m_affinity = affinity;
+            m_topology = probe_cpu_topology();
+            initialize_queue_orders();
+
+            m_num_logical_threads = affinity == WorkerAffinity::NONE ? std::thread::hardware_concurrency() : uint32_t(m_topology.cpus.size());
+            m_num_worker_threads = std::min(max_workers, m_num_logical_threads);
+
+			initialize_workers(std::min(min_workers, m_num_worker_threads), m_num_worker_threads);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        ~BasicThreadPool()
+        {
+            {
+                // Taken so no worker gets started once shutdown is set.
+                std::lock_guard<std::mutex> lock(m_resize_mutex);
+                m_shutdown = true;
+            }
+
+            m_parking.notify_all();
+
+            // Join every worker before any deque goes away, a worker may still be stealing from its neighbours.
+            // Retired slots still hold their finished thread until a new worker takes the slot.
+            for (uint32_t i = 0; i < m_num_worker_threads; i++)
+            {
+                if (m_worker_threads[i].m_thread.joinable())
+                    m_worker_threads[i].m_thread.join();
+            }
+
+			m_worker_threads.reset();
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Tasks are recycled once they (and every task that depends on them) have finished, so a task that is
+        // allocated has to be enqueued eventually or its slot is lost until the pool is destroyed.
+        inline Task* allocate()
+        {
+            Task* task_ptr = m_task_allocator.allocate(current_worker_index());
+
+            if (!task_ptr)
+                return nullptr;
+
+            initialize_task(task_ptr);
+            return task_ptr;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Allocates count tasks at once, or none at all if the pool can't hold that many (returns false).
+        inline bool allocate_batch(Task** tasks, uint32_t count)
+        {
+            const uint32_t worker_index = current_worker_index();
+            const uint32_t num_allocated = m_task_allocator.allocate_batch(tasks, count, worker_index);
+
+            if (num_allocated < count)
+            {
+                for (uint32_t i = 0; i < num_allocated; i++)
+                    m_task_allocator.free(tasks[i], worker_index);
+
+                return false;
+            }
+
+            for (uint32_t i = 0; i < count; i++)
+                initialize_task(tasks[i]);
+
+            return true;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Allocates a task that runs the given callable. The callable is stored inline in the task data, so it has
+        // to fit in Traits::TASK_SIZE_BYTES; it is destroyed right after it runs.
+        template <typename F>
+        inline Task* allocate(F&& callable)
+        {
+            typedef typename std::decay<F>::type Callable;
+
+            static_assert(sizeof(Callable) <= Traits::TASK_SIZE_BYTES, "Callable does not fit in Traits::TASK_SIZE_BYTES");
+            static_assert(alignof(Callable) <= 16, "Callable is over-aligned for the task data");
+
+            Task* task_ptr = allocate();
+
+            if (!task_ptr)
+                return nullptr;
+
+            new (task_ptr->data) Callable(std::forward<F>(callable));
+            task_ptr->function = &invoke_callable<Callable>;
+            task_ptr->flags |= detail::TASK_FLAG_OWNS_DATA;
+            return task_ptr;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Allocates and enqueues a task running the given callable in one go.
+        template <typename F>
+        inline typename std::enable_if<std::is_void<typename CallResult<F>::type>::value, TaskHandle>::type submit(F&& callable, TaskPriority priority = TaskPriority::NORMAL)
+        {
+            Task*      task_ptr = allocate(std::forward<F>(callable));
+            TaskHandle task_handle = { detail::INVALID_TASK_INDEX, 0 };
+
+            if (task_ptr)
+            {
+                task_ptr->priority = priority;
+                task_handle = handle(task_ptr);
+                enqueue(task_ptr);
+            }
+
+            return task_handle;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Allocates a task whose parameters live in the frame arena instead of the task data, for payloads that don't
+        // fit in Traits::TASK_SIZE_BYTES. function receives the payload, fill it in through payload() before enqueueing. The
+        // payload is only valid until the next reset_frame_arena().
+        inline Task* allocate(TaskFunction function, size_t payload_size, size_t alignment = 16)
+        {
+            void* payload_ptr = frame_alloc(payload_size, alignment);
+
+            if (!payload_ptr)
+                return nullptr;
+
+            Task* task_ptr = allocate();
+
+            if (!task_ptr)
+                return nullptr;
+
+            PayloadCall* call = new (task_ptr->data) PayloadCall;
+            call->function = function;
+            call->payload = payload_ptr;
+#if THREAD_POOL_ARENA_CHECKS
+            call->pool = this;
+            call->epoch = m_arena_epoch.load(std::memory_order_relaxed);
+#endif
+            task_ptr->function = &invoke_payload;
+
+            return task_ptr;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Payload of a task allocated with a payload size, nullptr for any other task.
+        inline void* payload(Task* task)
+        {
+            return task->function == &invoke_payload ? reinterpret_cast<PayloadCall*>(task->data)->payload : nullptr;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Bump allocates from the calling thread's frame arena. Nothing is freed individually; everything goes away
+        // at once with reset_frame_arena(). Returns nullptr if the system is out of memory.
+        inline void* frame_alloc(size_t size, size_t alignment)
+        {
+            const uint32_t epoch = m_arena_epoch.load(std::memory_order_acquire);
+            const uint32_t worker_index = current_worker_index();
+
+            if (worker_index != detail::INVALID_WORKER_INDEX)
+                return m_arenas[worker_index].allocate(size, alignment, epoch);
+
+            // Threads outside the pool share the last arena.
+            std::lock_guard<std::mutex> lock(m_external_arena_mutex);
+            return m_arenas[m_num_worker_threads].allocate(size, alignment, epoch);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Constructs a T in the frame arena. Destructors are never run, hence the trivially destructible requirement.
+        template <typename T, typename... Args>
+        inline T* frame_alloc(Args&&... args)
+        {
+            static_assert(std::is_trivially_destructible<T>::value, "Frame arena objects are never destroyed");
+
+            void* ptr = frame_alloc(sizeof(T), alignof(T));
+            return ptr ? new (ptr) T(std::forward<Args>(args)...) : nullptr;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Ends the current frame: every frame_alloc() allocation and task payload made so far becomes invalid. Only
+        // call it once nothing using them is in flight, e.g. right after wait_for_all(). O(1), each arena rewinds on
+        // its next allocation. With THREAD_POOL_ARENA_CHECKS the memory is poisoned right away instead.
+        inline void reset_frame_arena()
+        {
+            const uint32_t epoch = m_arena_epoch.fetch_add(1, std::memory_order_acq_rel) + 1;
+
+#if THREAD_POOL_ARENA_CHECKS
+            std::lock_guard<std::mutex> lock(m_external_arena_mutex);
+
+            for (uint32_t i = 0; i <= m_num_worker_threads; i++)
+                m_arenas[i].reset(epoch);
+#else
+            (void)epoch;
+#endif
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Callables returning a value hand back a Future instead. The callable and then the result are kept in the
+        // task itself, so both have to fit in Traits::TASK_SIZE_BYTES - FUTURE_STORAGE_OFFSET. Returns an invalid future if
+        // the pool is out of tasks.
+        template <typename F>
+        inline typename std::enable_if<!std::is_void<typename CallResult<F>::type>::value, Future<typename CallResult<F>::type, Traits> >::type submit(F&& callable, TaskPriority priority = TaskPriority::NORMAL)
+        {
+            typedef typename CallResult<F>::type Result;
+
+            Task* task_ptr = allocate_future<Result>(std::forward<F>(callable));
+
+            if (task_ptr)
+            {
+                task_ptr->priority = priority;
+                enqueue(task_ptr);
+            }
+
+            return Future<Result, Traits>(this, task_ptr);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Same as submit(), but the task is added to group first.
+        template <typename F>
+        inline typename std::enable_if<std::is_void<typename CallResult<F>::type>::value, TaskHandle>::type submit(TaskGroup& group, F&& callable, TaskPriority priority = TaskPriority::NORMAL)
+        {
+            Task*      task_ptr = allocate(std::forward<F>(callable));
+            TaskHandle task_handle = { detail::INVALID_TASK_INDEX, 0 };
+
+            if (task_ptr)
+            {
+                task_ptr->priority = priority;
+                set_group(task_ptr, group);
+                task_handle = handle(task_ptr);
+                enqueue(task_ptr);
+            }
+
+            return task_handle;
+        }
+
+        // A skipped task leaves its future without a result, check Future::is_cancelled() before get().
+        template <typename F>
+        inline typename std::enable_if<!std::is_void<typename CallResult<F>::type>::value, Future<typename CallResult<F>::type, Traits> >::type submit(TaskGroup& group, F&& callable, TaskPriority priority = TaskPriority::NORMAL)
+        {
+            typedef typename CallResult<F>::type Result;
+
+            Task* task_ptr = allocate_future<Result>(std::forward<F>(callable));
+
+            if (task_ptr)
+            {
+                task_ptr->priority = priority;
+                set_group(task_ptr, group);
+                enqueue(task_ptr);
+            }
+
+            return Future<Result, Traits>(this, task_ptr);
+        }
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline Task* allocate(TaskPriority priority)
+        {
+            Task* task_ptr = allocate();
+
+            if (task_ptr)
+                task_ptr->priority = priority;
+
+            return task_ptr;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline void set_priority(Task* task, TaskPriority priority)
+        {
+            task->priority = priority;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Hints that the task mostly touches memory on the given NUMA node (0 to num_numa_nodes() - 1). It is queued
+        // for that node's workers, who take it before anything from further away. Other nodes only get to it once
+        // they run out of work. Has no effect unless workers are pinned.
+        inline void set_numa_node(Task* task, uint32_t node)
+        {
+            task->numa_node = node < INVALID_NUMA_NODE ? uint8_t(node) : uint8_t(INVALID_NUMA_NODE);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Changes the order in which workers take tasks of the given priority level from their own deques. Can be
+        // changed while workers run, they pick it up with their next task.
+        inline void set_queue_order(TaskPriority priority, QueueOrder order)
+        {
+            m_queue_orders[uint32_t(priority)].store(order, std::memory_order_relaxed);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Take the handle before enqueueing, afterwards the task may already have finished and been recycled.
+        inline TaskHandle handle(Task* task)
+        {
+            TaskHandle task_handle = { task->index, task->generation.load(std::memory_order_acquire) };
+            return task_handle;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Makes child wait until parent has finished. Both tasks have to be set up before the parent is enqueued.
+        // Returns false if either task is out of edge capacity.
+		inline bool define_dependency(Task* child, Task* parent)
+		{
+			if (!parent || !child)
+                return false;
+
+            if (child->num_dependencies >= Traits::MAX_DEPENDENCIES)
+                return false;
+
+            if (!add_successor(parent, child))
+                return false;
+
+            child->num_dependencies++;
+            child->num_predecessors.fetch_add(1, std::memory_order_relaxed);
+
+            return true;
+		}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Enqueues continuation automatically once parent has finished, so it must not be enqueued by hand.
+        // Returns false if the parent is out of edge capacity.
+		inline bool define_continuation(Task* parent, Task* continuation)
+		{
+			if (!parent || !continuation)
+                return false;
+
+            if (!add_successor(parent, continuation))
+                return false;
+
+            // The first parent takes the place of the enqueue() call, any further ones have to finish as well.
+            if (continuation->num_continuation_parents++ > 0)
+                continuation->num_predecessors.fetch_add(1, std::memory_order_relaxed);
+
+            return true;
+		}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Adds task to group, which then counts it until it has finished or was skipped. Has to happen before the task
+        // is enqueued. Returns false for graph tasks and tasks that are already in a group.
+        inline bool set_group(Task* task, TaskGroup& group)
+        {
+            if (!task || task->counter || (task->flags & detail::TASK_FLAG_STATIC))
+                return false;
+
+            group.m_num_pending.fetch_add(1, std::memory_order_relaxed);
+            task->group = &group;
+            task->counter = &group.m_num_pending;
+
+            return true;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // The parent only counts as finished (for waits, continuations and dependents) once the child has finished
+        // too. Call it before enqueueing the parent, or from inside the parent's own function; in both cases before
+        // enqueueing the child. Children don't inherit the parent's group.
+        inline bool add_as_child(Task* parent, Task* child)
+        {
+            if (!parent || !child || child->parent)
+                return false;
+
+            parent->num_open.fetch_add(1, std::memory_order_relaxed);
+            child->parent = parent;
+
+            return true;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // The task is only pushed to a queue once all of its dependencies have finished.
+        inline void enqueue(Task* task)
+        {
+            if (task)
+                resolve_predecessor(task);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Same as calling enqueue() on every task, but the tasks that become runnable are published together: one
+        // queue reservation, one pending counter update and only as many wake-ups as there are tasks.
+        inline void enqueue_batch(Task** tasks, uint32_t count)
+        {
+            uint32_t run_begin = 0;
+
+            // Runs of tasks that became runnable are published straight from the caller's array.
+            for (uint32_t i = 0; i < count; i++)
+            {
+                if ((tasks[i]->num_predecessors.fetch_sub(1, std::memory_order_acq_rel) & detail::PREDECESSOR_COUNT_MASK) != 1)
+                {
+                    push_batch(tasks + run_begin, i - run_begin);
+                    run_begin = i + 1;
+                }
+            }
+
+            push_batch(tasks + run_begin, count - run_begin);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline void enqueue(Task* task, TaskPriority priority)
+        {
+            if (task)
+            {
+                task->priority = priority;
+                resolve_predecessor(task);
+            }
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+		inline bool is_done(Task* task)
+		{
+			return task->num_pending == 0;
+		}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+		inline bool is_done(TaskHandle task_handle)
+		{
+            Task* task = resolve(task_handle);
+			return !task || task->num_pending == 0;
+		}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Returns once every submitted task has finished, continuations and successors included. Spins for a
+        // little while, then helps running queued tasks and finally sleeps until the last task completes.
+        inline void wait_for_all()
+        {
+            wait_until_done(AllDone(this), nullptr, nullptr);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Same as wait_for_all() but gives up after timeout. Returns false if tasks were still pending by then. Unlike
+        // the untimed wait it doesn't run queued tasks itself, except in a pool without workers, where a task it
+        // picks up can overrun the timeout by its length.
+        template <typename Rep, typename Period>
+        inline bool wait_for_all(const std::chrono::duration<Rep, Period>& timeout)
+        {
+            const std::chrono::steady_clock::time_point deadline = deadline_after(timeout);
+            return wait_until_done(AllDone(this), &deadline, nullptr);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // The task must not have been recycled yet, prefer the TaskHandle overload when that isn't certain.
+        inline void wait_for_one(Task* pending_task)
+        {
+            wait_until_done(TaskDone(pending_task), nullptr, &pending_task->num_waiters);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline void wait_for_one(TaskHandle task_handle)
+        {
+            Task* task = resolve(task_handle);
+
+            if (task)
+                wait_until_done(HandleDone(this, task_handle), nullptr, &task->num_waiters);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Timed versions of wait_for_one(). Return true if the task finished, false if the timeout passed first.
+        // They only spin and sleep instead of helping, so a long task can't hold the caller past the deadline. The
+        // exception is a pool without workers: nobody else would run the task, so the caller does and may overrun.
+        template <typename Rep, typename Period>
+        inline bool wait_for(Task* pending_task, const std::chrono::duration<Rep, Period>& timeout)
+        {
+            const std::chrono::steady_clock::time_point deadline = deadline_after(timeout);
+            return wait_until_done(TaskDone(pending_task), &deadline, &pending_task->num_waiters);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        template <typename Rep, typename Period>
+        inline bool wait_for(TaskHandle task_handle, const std::chrono::duration<Rep, Period>& timeout)
+        {
+            const std::chrono::steady_clock::time_point deadline = deadline_after(timeout);
+            return wait_for_handle(task_handle, &deadline);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        template <typename Clock, typename Duration>
+        inline bool wait_until(Task* pending_task, const std::chrono::time_point<Clock, Duration>& time)
+        {
+            const std::chrono::steady_clock::time_point deadline = deadline_after(time - Clock::now());
+            return wait_until_done(TaskDone(pending_task), &deadline, &pending_task->num_waiters);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        template <typename Clock, typename Duration>
+        inline bool wait_until(TaskHandle task_handle, const std::chrono::time_point<Clock, Duration>& time)
+        {
+            const std::chrono::steady_clock::time_point deadline = deadline_after(time - Clock::now());
+            return wait_for_handle(task_handle, &deadline);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Launches a compiled graph. The graph must not be relaunched (or recompiled) before the previous run is done.
+        // Returns false if the graph isn't compiled.
+        inline bool run(TaskGraph& graph)
+        {
+            if (!graph.m_compiled)
+                return false;
+
+            if (graph.m_num_tasks == 0)
+                return true;
+
+            graph.m_num_remaining.store(graph.m_num_tasks, std::memory_order_relaxed);
+
+            for (uint32_t i = 0; i < graph.m_num_tasks; i++)
+            {
+                Task& task = graph.m_tasks[i];
+                task.num_pending.store(1, std::memory_order_relaxed);
+                task.num_open.store(1, std::memory_order_relaxed);
+                task.num_predecessors.store(graph.m_initial_predecessors[i], std::memory_order_relaxed);
+            }
+
+            // The release in push_batch() publishes the resets above to whichever threads run the graph.
+            push_batch(graph.m_roots.data(), uint32_t(graph.m_roots.size()));
+
+            return true;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Helps executing tasks until every node of the last run of graph has finished.
+        inline void wait_for_graph(TaskGraph& graph)
+        {
+            wait_until_done(CounterDone(&graph.m_num_remaining), nullptr, nullptr);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Helps executing tasks until every task of group has finished or was skipped.
+        inline void wait_for_group(TaskGroup& group)
+        {
+            wait_until_done(CounterDone(&group.m_num_pending), nullptr, nullptr);
+        }
+
+        // Returns false if the group still had unfinished tasks when timeout ran out. Doesn't help with queued tasks
+        // unless the pool has no workers, see wait_for().
+        template <typename Rep, typename Period>
+        inline bool wait_for_group(TaskGroup& group, const std::chrono::duration<Rep, Period>& timeout)
+        {
+            const std::chrono::steady_clock::time_point deadline = deadline_after(timeout);
+            return wait_until_done(CounterDone(&group.m_num_pending), &deadline, nullptr);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Calls function(i) for every i in [begin, end). Ranges are split lazily: a range only hands half of itself
+        // to another task when some worker is idle or has stolen the previous half, and never below grain elements.
+        // The calling thread works on the range as well and returns once every element has been processed.
+        template <typename F>
+        inline void parallel_for(uint32_t begin, uint32_t end, uint32_t grain, F&& function)
+        {
+            typedef typename std::remove_reference<F>::type Function;
+
+            ParallelForBody<Function> body;
+            body.function = &function;
+
+            run_parallel_range(body, begin, end, grain);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Reduces map(i) for every i in [begin, end) with combine, starting from identity. Ranges are split like in
+        // parallel_for(), never below grain elements. Every split keeps its own partial result and the halves are joined
+        // in range order, so combine only has to be associative: the result is the same as folding from left to right.
+        template <typename T, typename Map, typename Combine>
+        inline T parallel_reduce(uint32_t begin, uint32_t end, uint32_t grain, const T& identity, Map&& map, Combine&& combine)
+        {
+            typedef typename std::remove_reference<Map>::type     MapFunction;
+            typedef typename std::remove_reference<Combine>::type CombineFunction;
+
+            if (begin >= end)
+                return identity;
+
+            typedef ParallelReduceBody<T, MapFunction, CombineFunction> Body;
+
+            Body body;
+            body.identity_value = &identity;
+            body.map = &map;
+            body.combine_function = &combine;
+
+            ParallelRange<Body> range;
+            range.body = &body;
+            range.grain = std::max(grain, 1u);
+
+            // The root range runs on this thread and only returns once everything it split off has been joined.
+            ReduceSlot<T> root;
+            execute_reduce_range(&range, begin, end, &root);
+
+            T result(std::move(root.value()));
+            root.value().~T();
+
+            return result;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Returns an awaitable that resumes the awaiting coroutine on one of the workers.
+        inline ScheduleAwaiter<BasicThreadPool> schedule(TaskPriority priority = TaskPriority::NORMAL)
+        {
+            ScheduleAwaiter<BasicThreadPool> awaiter = { this, priority };
+            return awaiter;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Runs one queued task on the calling thread, if there is one. Returns false if no task was found.
+        inline bool run_one()
+        {
+            Task* task = find_task();
+
+            if (!task)
+                return false;
+
+            run_task(task);
+
+            return true;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Helps executing tasks until counter drops to zero, then sleeps like the wait_*() calls once there is nothing
+        // left to help with. Whoever takes counter to zero has to call notify_waiters() afterwards.
+        inline void wait_for_counter(std::atomic<uint32_t>& counter)
+        {
+            wait_until_done(CounterDone(&counter), nullptr, nullptr);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Wakes threads sleeping in a wait so they recheck what they are waiting for.
+        inline void notify_waiters()
+        {
+            if (m_completion.has_waiters())
+                m_completion.notify_all();
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Blocks for short lived allocations such as coroutine frames. They have to be freed before the pool is destroyed.
+        inline void* allocate_frame(size_t size)
+        {
+            return m_frame_allocator.allocate(size, current_worker_index());
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline void free_frame(void* ptr, size_t size)
+        {
+            m_frame_allocator.free(ptr, size, current_worker_index());
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline uint32_t num_logical_threads()
+        {
+            return m_num_logical_threads;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Workers running right now, which changes over time in an elastic pool.
+        inline uint32_t num_worker_threads()
+        {
+            return m_num_live_workers.load(std::memory_order_relaxed);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Most workers the pool can ever run, the upper bound for resize().
+        inline uint32_t max_worker_threads()
+        {
+            return m_num_worker_threads;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Runs exactly workers threads from now on (capped at max_worker_threads()). Safe while tasks are in flight:
+        // missing workers start right away, surplus ones retire as soon as they run out of local work.
+        inline void resize(uint32_t workers)
+        {
+            resize(workers, workers);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Lets the number of workers float between min_workers and max_workers, see the elastic constructor.
+        inline void resize(uint32_t min_workers, uint32_t max_workers)
+        {
+            bool shrink = false;
+
+            {
+                std::lock_guard<std::mutex> lock(m_resize_mutex);
+
+                const uint32_t max_live = std::min(max_workers, m_num_worker_threads);
+                const uint32_t min_live = std::min(min_workers, max_live);
+
+                m_min_workers.store(min_live, std::memory_order_relaxed);
+                m_max_workers.store(max_live, std::memory_order_relaxed);
+
+                while (m_num_live_workers.load(std::memory_order_relaxed) < min_live && start_worker())
+                    ;
+
+                shrink = m_num_live_workers.load(std::memory_order_relaxed) > min_live;
+            }
+
+            // Parked workers have to wake up to notice they are surplus, or to park again with a timeout.
+            if (shrink)
+                m_parking.notify_all();
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // 1 unless workers are pinned.
+        inline uint32_t num_numa_nodes()
+        {
+            return m_num_numa_nodes;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // NUMA node of the calling worker, INVALID_NUMA_NODE if called from outside the pool.
+        inline uint32_t current_numa_node()
+        {
+            const uint32_t worker_index = current_worker_index();
+            return worker_index == detail::INVALID_WORKER_INDEX ? INVALID_NUMA_NODE : m_worker_threads[worker_index].m_numa_node;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline const CpuTopology& topology()
+        {
+            return m_topology;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Aggregates the counters while the workers keep running, so the numbers aren't one consistent instant,
+        // each of them is just at least as recent as the call.
+        inline ThreadPoolStats stats()
+        {
+            ThreadPoolStats result;
+
+            if (!Traits::STATS)
+                return result;
+
+            result.workers.resize(m_num_worker_threads);
+
+            for (uint32_t i = 0; i <= m_num_worker_threads; i++)
+            {
+                WorkerCounters& counters = m_counters[i];
+                WorkerStats     worker_stats;
+
+                worker_stats.tasks_executed = counters.tasks_executed.load(std::memory_order_relaxed);
+                worker_stats.steals_attempted = counters.steals_attempted.load(std::memory_order_relaxed);
+                worker_stats.steals_succeeded = counters.steals_succeeded.load(std::memory_order_relaxed);
+                worker_stats.busy_ns = counters.busy_ns.load(std::memory_order_relaxed);
+                worker_stats.idle_ns = counters.idle_ns.load(std::memory_order_relaxed);
+                worker_stats.parked_ns = counters.parked_ns.load(std::memory_order_relaxed);
+                worker_stats.wakeups = counters.wakeups.load(std::memory_order_relaxed);
+                worker_stats.max_queue_depth = counters.max_queue_depth.load(std::memory_order_relaxed);
+
+                if (i < m_num_worker_threads)
+                    result.workers[i] = worker_stats;
+
+                result.total.tasks_executed += worker_stats.tasks_executed;
+                result.total.steals_attempted += worker_stats.steals_attempted;
+                result.total.steals_succeeded += worker_stats.steals_succeeded;
+                result.total.busy_ns += worker_stats.busy_ns;
+                result.total.idle_ns += worker_stats.idle_ns;
+                result.total.parked_ns += worker_stats.parked_ns;
+                result.total.wakeups += worker_stats.wakeups;
+                result.total.max_queue_depth = std::max(result.total.max_queue_depth, worker_stats.max_queue_depth);
+
+                for (uint32_t j = 0; j < detail::LATENCY_BUCKETS; j++)
+                {
+                    result.wait_latency.buckets[j] += counters.wait_latency[j].load(std::memory_order_relaxed);
+                    result.run_latency.buckets[j] += counters.run_latency[j].load(std::memory_order_relaxed);
+                }
+            }
+
+            for (uint32_t i = 0; i < detail::NUM_TASK_PRIORITIES; i++)
+                result.max_injection_depth = std::max(result.max_injection_depth, uint64_t(m_injection_queues[i].high_water()));
+
+            for (uint32_t i = 0; m_node_queues && i < m_num_numa_nodes * detail::NUM_TASK_PRIORITIES; i++)
+                result.max_injection_depth = std::max(result.max_injection_depth, uint64_t(m_node_queues[i].high_water()));
+
+            return result;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Label for the task in dump_trace(). Has to outlive the trace (string literals are ideal).
+        inline void set_name(Task* task, const char* name)
+        {
+            task->name.set(name);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Pauses or resumes recording. Tracing starts enabled when the traits turn TRACE on.
+        inline void set_tracing(bool enabled)
+        {
+            if (Traits::TRACE)
+                m_tracing.store(enabled, std::memory_order_relaxed);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Writes whatever the trace rings currently hold in Chrome trace-event format (chrome://tracing, Perfetto):
+        // task and parked slices per thread, enqueue/steal instants and flow arrows along every successor edge.
+        // Can be called while tasks are running, events written during the dump may be missing. Returns false if
+        // tracing is compiled out or the file can't be written.
+        inline bool dump_trace(const char* path)
+        {
+            if (!Traits::TRACE)
+                return false;
+
+            struct Record
+            {
+                uint64_t time;
+                uint64_t task;
+                uint64_t other;
+                uint32_t type;
+                uint32_t thread;
+            };
+
+            std::vector<Record> records;
+
+            for (uint32_t i = 0; i <= m_num_worker_threads; i++)
+            {
+                TraceRing&     buffer = m_trace_buffers[i];
+                const uint64_t head = buffer.m_head.load(std::memory_order_acquire);
+
+                for (uint64_t slot = head > Traits::TRACE_BUFFER_SIZE ? head - Traits::TRACE_BUFFER_SIZE : 0; slot < head; slot++)
+                {
+                    TraceEvent&    event = buffer.m_events[slot % Traits::TRACE_BUFFER_SIZE];
+                    const uint64_t sequence = event.sequence.load(std::memory_order_acquire);
+                    const uint64_t thread = event.thread.load(std::memory_order_relaxed);
+                    Record         record;
+
+                    record.time = event.time.load(std::memory_order_relaxed);
+                    record.task = event.task.load(std::memory_order_relaxed);
+                    record.other = event.other.load(std::memory_order_relaxed);
+                    record.type = uint32_t(thread >> 32);
+                    record.thread = uint32_t(thread);
+
+                    // Skip slots that were still being written or got overwritten while we read them.
+                    std::atomic_thread_fence(std::memory_order_acquire);
+
+                    if (sequence == slot * 2 + 2 && event.sequence.load(std::memory_order_relaxed) == sequence)
+                        records.push_back(record);
+                }
+            }
+
+            FILE* file = fopen(path, "w");
+
+            if (!file)
+                return false;
+
+            std::stable_sort(records.begin(), records.end(), [](const Record& a, const Record& b) {
+                return a.thread != b.thread ? a.thread < b.thread : a.time < b.time;
+            });
+
+            // Task starts sorted by id, so a released successor can find the run it released.
+            std::vector<Record> begins;
+            uint64_t            base_time = records.empty() ? 0 : records[0].time;
+
+            for (size_t i = 0; i < records.size(); i++)
+            {
+                base_time = std::min(base_time, records[i].time);
+
+                if (records[i].type == TRACE_TASK_BEGIN)
+                    begins.push_back(records[i]);
+            }
+
+            std::sort(begins.begin(), begins.end(), [](const Record& a, const Record& b) {
+                return a.task != b.task ? a.task < b.task : a.time < b.time;
+            });
+
+            fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+            fprintf(file, "{\"ph\":\"M\",\"pid\":1,\"tid\":0,\"name\":\"process_name\",\"args\":{\"name\":\"dwThreadPool\"}}");
+
+            std::vector<Record> open;
+            uint64_t            flow_id = 0;
+
+            for (size_t i = 0; i < records.size(); i++)
+            {
+                const Record& record = records[i];
+                const double  ts = double(record.time - base_time) / 1000.0;
+
+                if (i == 0 || records[i - 1].thread != record.thread)
+                {
+                    open.clear();
+
+                    if (record.thread & 0x80000000u)
+                        fprintf(file, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"external %u\"}}", record.thread, record.thread & 0x7FFFFFFFu);
+                    else
+                        fprintf(file, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"worker %u\"}}", record.thread, record.thread);
+                }
+
+                switch (record.type)
+                {
+                    case TRACE_TASK_BEGIN:
+                    case TRACE_PARK:
+                        open.push_back(record);
+                        break;
+
+                    case TRACE_TASK_END:
+                    case TRACE_UNPARK:
+                    {
+                        // Ends without a start were cut off by the ring and are dropped.
+                        const uint32_t begin_type = record.type == TRACE_TASK_END ? uint32_t(TRACE_TASK_BEGIN) : uint32_t(TRACE_PARK);
+
+                        for (size_t j = open.size(); j > 0; j--)
+                        {
+                            const Record& begin = open[j - 1];
+
+                            if (begin.type != begin_type || begin.task != record.task)
+                                continue;
+
+                            const double begin_ts = double(begin.time - base_time) / 1000.0;
+
+                            if (begin_type == TRACE_PARK)
+                                fprintf(file, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"cat\":\"scheduler\",\"name\":\"parked\"}", record.thread, begin_ts, ts - begin_ts);
+                            else
+                            {
+                                const char* name = reinterpret_cast<const char*>(uintptr_t(begin.other));
+
+                                fprintf(file, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"cat\":\"task\",\"name\":", record.thread, begin_ts, ts - begin_ts);
+                                write_json_string(file, name ? name : "task");
+                                fprintf(file, ",\"args\":{\"id\":\"0x%llx\"}}", (unsigned long long)record.task);
+                            }
+
+                            open.erase(open.begin() + (j - 1));
+                            break;
+                        }
+
+                        break;
+                    }
+
+                    case TRACE_ENQUEUE:
+                        fprintf(file, ",\n{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"cat\":\"scheduler\",\"name\":\"enqueue\",\"args\":{\"id\":\"0x%llx\"}}", record.thread, ts, (unsigned long long)record.task);
+                        break;
+
+                    case TRACE_STEAL:
+                        fprintf(file, ",\n{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"cat\":\"scheduler\",\"name\":\"steal\",\"args\":{\"id\":\"0x%llx\",\"victim\":%llu}}", record.thread, ts, (unsigned long long)record.task, (unsigned long long)record.other);
+                        break;
+
+                    case TRACE_RELEASE:
+                    {
+                        // Arrow from the releasing task to the first run of the successor after the release.
+                        Record key = record;
+                        key.task = record.other;
+
+                        typename std::vector<Record>::iterator it = std::lower_bound(begins.begin(), begins.end(), key, [](const Record& a, const Record& b) {
+                            return a.task != b.task ? a.task < b.task : a.time < b.time;
+                        });
+
+                        if (it == begins.end() || it->task != record.other)
+                            break;
+
+                        fprintf(file, ",\n{\"ph\":\"s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"id\":%llu,\"cat\":\"edge\",\"name\":\"successor\"}", record.thread, ts, (unsigned long long)flow_id);
+                        fprintf(file, ",\n{\"ph\":\"f\",\"bp\":\"e\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"id\":%llu,\"cat\":\"edge\",\"name\":\"successor\"}", it->thread, double(it->time - base_time) / 1000.0, (unsigned long long)flow_id);
+                        flow_id++;
+                        break;
+                    }
+                }
+            }
+
+            fprintf(file, "\n]}\n");
+
+            return fclose(file) == 0;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    private:
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline void initialize_task(Task* task)
+        {
+            task->priority = TaskPriority::NORMAL;
+
+            // The initial predecessor stands for the enqueue() call (or the first parent defining it as a continuation).
+            task->num_pending = 1;
+            task->num_predecessors = 1;
+            task->num_refs = 1;
+            task->num_open = 1;
+            task->parent = nullptr;
+            task->function = nullptr;
+            task->edges = nullptr;
+            task->counter = nullptr;
+            task->group = nullptr;
+            task->flags = 0;
+            task->numa_node = INVALID_NUMA_NODE;
+            task->name.set(nullptr);
+            task->num_dependencies = 0;
+            task->num_continuation_parents = 0;
+            task->edge_state.store(EDGES_OPEN, std::memory_order_relaxed);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline void initialize_queue_orders()
+        {
+            // Latency sensitive and background work is served oldest first, normal work that a worker spawned itself
+            // newest first for cache reuse.
+            m_queue_orders[uint32_t(TaskPriority::CRITICAL)].store(QueueOrder::FIFO, std::memory_order_relaxed);
+            m_queue_orders[uint32_t(TaskPriority::NORMAL)].store(QueueOrder::LIFO, std::memory_order_relaxed);
+            m_queue_orders[uint32_t(TaskPriority::BACKGROUND)].store(QueueOrder::FIFO, std::memory_order_relaxed);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Everything per worker is sized for max_workers up front, so workers can come and go without
+        // reallocating anything other threads might be looking at.
+        inline void initialize_workers(uint32_t num_workers, uint32_t max_workers)
+        {
+            m_task_allocator.initialize(m_num_worker_threads);
+            m_edge_allocator.initialize(m_num_worker_threads);
+            m_frame_allocator.initialize(m_num_worker_threads);
+
+            if (Traits::STATS)
+                m_counters.reset(new WorkerCounters[m_num_worker_threads + 1]);
+
+            m_arenas.reset(new LinearArena[m_num_worker_threads + 1]);
+            m_arena_epoch = 0;
+
+            m_tracing = Traits::TRACE;
+
+            if (Traits::TRACE)
+                m_trace_buffers.reset(new TraceRing[m_num_worker_threads + 1]);
+
+            // spawn worker threads
+            m_worker_threads.reset(new WorkerThread[m_num_worker_threads]);
+
+            initialize_placement();
+
+            m_num_live_workers = 0;
+            m_min_workers = num_workers;
+            m_max_workers = max_workers;
+
+            std::lock_guard<std::mutex> lock(m_resize_mutex);
+
+            for (uint32_t i = 0; i < num_workers; i++)
+                start_worker();
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Starts a worker in the first free slot. Must hold m_resize_mutex.
+        inline bool start_worker()
+        {
+            if (m_shutdown)
+                return false;
+
+            for (uint32_t i = 0; i < m_num_worker_threads; i++)
+            {
+                WorkerThread& worker_thread = m_worker_threads[i];
+
+                if (worker_thread.m_active.load(std::memory_order_relaxed))
+                    continue;
+
+                // A retired worker gave up the slot under the lock, so its thread is already on the way out.
+                if (worker_thread.m_thread.joinable())
+                    worker_thread.m_thread.join();
+
+                worker_thread.m_active.store(true, std::memory_order_relaxed);
+                m_num_live_workers.fetch_add(1, std::memory_order_seq_cst);
+                worker_thread.m_thread = std::thread(&BasicThreadPool::worker, this, i);
+
+                return true;
+            }
+
+            return false;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Called after every push. Starts another worker when the pool is below its maximum, nobody is idle and
+        // the backlog per worker has grown past WORKER_SPAWN_BACKLOG. Fixed size pools bail out on the first check.
+        inline void grow_if_needed(uint32_t num_pending)
+        {
+            const uint32_t num_live = m_num_live_workers.load(std::memory_order_relaxed);
+
+            if (num_live >= m_max_workers.load(std::memory_order_relaxed))
+                return;
+
+            if (num_live != 0 && (m_num_idle.load(std::memory_order_relaxed) != 0 || num_pending < num_live * detail::WORKER_SPAWN_BACKLOG))
+                return;
+
+            // Nobody else can pick up the work without workers, so that case waits for the lock.
+            std::unique_lock<std::mutex> lock(m_resize_mutex, std::defer_lock);
+
+            if (num_live == 0)
+                lock.lock();
+            else if (!lock.try_lock())
+                return;
+
+            if (m_num_live_workers.load(std::memory_order_relaxed) < m_max_workers.load(std::memory_order_relaxed))
+                start_worker();
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Gives up the worker's slot if there are more workers than wanted: more than the maximum, or more than the
+        // minimum once the worker has been idle for WORKER_IDLE_TIMEOUT_MS. Only workers with empty deques retire,
+        // and the last one stays while tasks are pending.
+        inline bool try_retire(uint32_t index, bool idle_timeout)
+        {
+            std::lock_guard<std::mutex> lock(m_resize_mutex);
+
+            const uint32_t num_live = m_num_live_workers.load(std::memory_order_relaxed);
+            const uint32_t floor = idle_timeout ? m_min_workers.load(std::memory_order_relaxed) : m_max_workers.load(std::memory_order_relaxed);
+
+            if (m_shutdown || num_live <= floor)
+                return false;
+
+            WorkerThread& worker_thread = m_worker_threads[index];
+
+            for (uint32_t level = 0; level < detail::NUM_TASK_PRIORITIES; level++)
+            {
+                if (!worker_thread.m_deques[level].empty())
+                    return false;
+            }
+
+            // Pairs with the fence in push(): either the pusher sees no workers left and starts one, or we see its task.
+            m_num_live_workers.fetch_sub(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (num_live == 1 && m_num_pending_tasks.load(std::memory_order_relaxed) != 0)
+            {
+                m_num_live_workers.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            worker_thread.m_active.store(false, std::memory_order_relaxed);
+
+            return true;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Assigns every worker a CPU in topology order and sorts its steal victims by distance.
+        inline void initialize_placement()
+        {
+            const bool pinned = m_affinity != WorkerAffinity::NONE;
+
+            m_num_numa_nodes = pinned ? std::min(m_topology.num_nodes, uint32_t(INVALID_NUMA_NODE)) : 1;
+
+            if (m_num_numa_nodes > 1)
+                m_node_queues.reset(new SharedQueue[m_num_numa_nodes * detail::NUM_TASK_PRIORITIES]);
+
+            for (uint32_t i = 0; i < m_num_worker_threads; i++)
+            {
+                WorkerThread& worker_thread = m_worker_threads[i];
+
+                worker_thread.m_cpu = i % uint32_t(m_topology.cpus.size());
+                worker_thread.m_numa_node = pinned ? std::min(m_topology.cpus[worker_thread.m_cpu].node, m_num_numa_nodes - 1) : 0;
+            }
+
+            for (uint32_t i = 0; i < m_num_worker_threads; i++)
+            {
+                WorkerThread& worker_thread = m_worker_threads[i];
+
+                for (uint32_t tier = 0; tier < detail::NUM_STEAL_TIERS; tier++)
+                {
+                    for (uint32_t j = 0; j < m_num_worker_threads; j++)
+                    {
+                        if (j != i && steal_distance(i, j) == tier)
+                            worker_thread.m_victims.push_back(j);
+                    }
+
+                    worker_thread.m_victim_tiers[tier] = uint32_t(worker_thread.m_victims.size());
+                }
+            }
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // 0: shared L2, 1: shared L3, 2: same NUMA node, 3: anything else. Unpinned workers can be anywhere.
+        inline uint32_t steal_distance(uint32_t a, uint32_t b)
+        {
+            if (m_affinity == WorkerAffinity::NONE)
+                return detail::NUM_STEAL_TIERS - 1;
+
+            const CpuInfo& cpu_a = m_topology.cpus[m_worker_threads[a].m_cpu];
+            const CpuInfo& cpu_b = m_topology.cpus[m_worker_threads[b].m_cpu];
+
+            // Node pinned workers move around within their node, so only the node says anything about caches.
+            if (m_affinity == WorkerAffinity::CORE)
+            {
+                if (cpu_a.l2 == cpu_b.l2)
+                    return 0;
+
+                if (cpu_a.l3 == cpu_b.l3)
+                    return 1;
+            }
+
+            return cpu_a.node == cpu_b.node ? 2 : 3;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+		inline void worker(uint32_t index)
+		{
+            ThreadContext& context = thread_context();
+            context.pool = this;
+            context.worker_index = index;
+            context.rng_state = index * 2654435761u + 1u;
+
+            if (m_affinity != WorkerAffinity::NONE)
+                pin_current_thread(m_topology, m_topology.cpus[m_worker_threads[index].m_cpu], m_affinity);
+
+			while (!m_shutdown)
+			{
+                // Surplus after a resize() leaves between tasks rather than waiting to go idle.
+                if (m_num_live_workers.load(std::memory_order_relaxed) > m_max_workers.load(std::memory_order_relaxed) && try_retire(index, false))
+                    return;
+
+				Task* task = find_task();
+                bool  timed_out = false;
+
+				if (!task)
+					task = idle(timed_out);
+
+                if (!task && timed_out && try_retire(index, true))
+                    return;
+
+				if (task)
+					run_task(task);
+			}
+		}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline Task* idle(bool& timed_out)
+        {
+            const uint64_t start_time = Traits::STATS ? now_ns() : 0;
+            const uint64_t parked_ns = Traits::STATS ? counters().parked_ns.load(std::memory_order_relaxed) : 0;
+
+            // Idle workers are what parallel_for() looks at to decide whether splitting a range is worth it.
+            m_num_idle.fetch_add(1, std::memory_order_relaxed);
+            Task* task = spin_then_park(timed_out);
+            m_num_idle.fetch_sub(1, std::memory_order_relaxed);
+
+            if (Traits::STATS)
+            {
+                // Time spent parked is accounted for separately by spin_then_park().
+                WorkerCounters& stats = counters();
+                const uint64_t  idle_ns = now_ns() - start_time;
+                const uint64_t  parked_delta = stats.parked_ns.load(std::memory_order_relaxed) - parked_ns;
+
+                WorkerCounters::add(stats.idle_ns, idle_ns > parked_delta ? idle_ns - parked_delta : 0);
+            }
+
+            return task;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Spin for a little while, then park until a submitter wakes us up. Returns a task if one showed up in the meantime.
+        // Workers above the minimum only park for WORKER_IDLE_TIMEOUT_MS and report when that ran out.
+        inline Task* spin_then_park(bool& timed_out)
+        {
+            if (Traits::WAIT_POLICY == WaitPolicy::SPIN)
+                return spin(timed_out);
+
+            const uint32_t spin_count = Traits::WAIT_POLICY == WaitPolicy::SLEEP ? 0u : detail::WORKER_SPIN_COUNT;
+
+            for (uint32_t i = 0; i < spin_count; i++)
+            {
+                cpu_pause();
+
+                Task* task = find_task();
+
+                if (task)
+                    return task;
+            }
+
+            const uint32_t key = m_parking.prepare_wait();
+
+            // Re-check after registering as a sleeper, otherwise a push that raced with us could go unnoticed.
+            Task* task = find_task();
+
+            if (task || m_shutdown)
+            {
+                m_parking.cancel_wait();
+                return task;
+            }
+
+            const uint64_t park_time = Traits::STATS ? now_ns() : 0;
+
+            if (Traits::TRACE)
+                trace(TRACE_PARK, 0, 0);
+
+            if (m_num_live_workers.load(std::memory_order_relaxed) > m_min_workers.load(std::memory_order_relaxed))
+                timed_out = !m_parking.commit_wait_until(key, std::chrono::steady_clock::now() + std::chrono::milliseconds(detail::WORKER_IDLE_TIMEOUT_MS));
+            else
+                m_parking.commit_wait(key);
+
+            if (Traits::TRACE)
+                trace(TRACE_UNPARK, 0, 0);
+
+            if (Traits::STATS)
+            {
+                WorkerCounters& stats = counters();
+                WorkerCounters::add(stats.parked_ns, now_ns() - park_time);
+                WorkerCounters::add(stats.wakeups, 1);
+            }
+
+            return nullptr;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // WaitPolicy::SPIN workers never park. They still give up the core between rounds, and still retire once
+        // surplus or idle for WORKER_IDLE_TIMEOUT_MS.
+        inline Task* spin(bool& timed_out)
+        {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            while (!m_shutdown)
+            {
+                for (uint32_t i = 0; i < detail::WORKER_SPIN_COUNT; i++)
+                {
+                    cpu_pause();
+
+                    Task* task = find_task();
+
+                    if (task)
+                        return task;
+                }
+
+                const uint32_t num_live = m_num_live_workers.load(std::memory_order_relaxed);
+
+                if (num_live > m_max_workers.load(std::memory_order_relaxed))
+                    return nullptr;
+
+                if (num_live > m_min_workers.load(std::memory_order_relaxed) && std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(detail::WORKER_IDLE_TIMEOUT_MS))
+                {
+                    timed_out = true;
+                    return nullptr;
+                }
+
+                std::this_thread::yield();
+            }
+
+            return nullptr;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline uint32_t current_worker_index()
+        {
+            ThreadContext& context = thread_context();
+            return context.pool == this ? context.worker_index : detail::INVALID_WORKER_INDEX;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Counters of the calling worker, threads outside the pool share the last set. Only with Traits::STATS.
+        inline WorkerCounters& counters()
+        {
+            const uint32_t worker_index = current_worker_index();
+            return m_counters[worker_index == detail::INVALID_WORKER_INDEX ? m_num_worker_threads : worker_index];
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Workers write their own ring, threads outside the pool share the last one.
+        inline void trace(uint32_t type, uint64_t task, uint64_t other)
+        {
+            if (!m_tracing.load(std::memory_order_relaxed))
+                return;
+
+            ThreadContext& context = thread_context();
+
+            if (context.pool == this)
+                m_trace_buffers[context.worker_index].record(type, context.worker_index, task, other);
+            else
+                m_trace_buffers[m_num_worker_threads].record(type, external_trace_tag(), task, other);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline bool has_pending_tasks()
+        {
+            return m_num_pending_tasks.load(std::memory_order_acquire) != 0;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Completion conditions for wait_until_done(). All loads are seq_cst to pair with the decrements in run_task().
+        struct AllDone
+        {
+            BasicThreadPool* pool;
+            explicit AllDone(BasicThreadPool* p) : pool(p) {}
+            bool operator()() const { return pool->m_num_pending_tasks.load(std::memory_order_seq_cst) == 0; }
+        };
+
+        struct TaskDone
+        {
+            Task* task;
+            explicit TaskDone(Task* t) : task(t) {}
+            bool operator()() const { return task->num_pending.load(std::memory_order_seq_cst) == 0; }
+        };
+
+        struct HandleDone
+        {
+            BasicThreadPool* pool;
+            TaskHandle       handle;
+            HandleDone(BasicThreadPool* p, TaskHandle h) : pool(p), handle(h) {}
+            bool operator()() const { return pool->is_done(handle); }
+        };
+
+        struct CounterDone
+        {
+            std::atomic<uint32_t>* counter;
+            explicit CounterDone(std::atomic<uint32_t>* c) : counter(c) {}
+            bool operator()() const { return counter->load(std::memory_order_seq_cst) == 0; }
+        };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        template <typename Rep, typename Period>
+        static inline std::chrono::steady_clock::time_point deadline_after(const std::chrono::duration<Rep, Period>& timeout)
+        {
+            return std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline bool wait_for_handle(TaskHandle task_handle, const std::chrono::steady_clock::time_point* deadline)
+        {
+            Task* task = resolve(task_handle);
+            return !task || wait_until_done(HandleDone(this, task_handle), deadline, &task->num_waiters);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Blocks until done() holds or the deadline (if any) passes, returning done(). Spins first, since most waits
+        // are short, then helps with queued tasks, then sleeps on m_completion. task_waiters, when given, tells
+        // run_task() that someone sleeps on that particular task. Workers never sleep here: the pool relies on them
+        // to drain their own deques, so once out of work they just yield. WaitPolicy::SPIN waiters never sleep either.
+        // Timed waits skip the helping, a task picked up just before the deadline could run arbitrarily long past it.
+        // Without workers there is no one else to run anything, so there they help anyway.
+        template <typename Done>
+        inline bool wait_until_done(const Done& done, const std::chrono::steady_clock::time_point* deadline, std::atomic<uint32_t>* task_waiters)
+        {
+            const bool     has_workers = m_max_workers.load(std::memory_order_relaxed) != 0;
+            const bool     can_help = !deadline || !has_workers;
+            const bool     can_sleep = Traits::WAIT_POLICY != WaitPolicy::SPIN && has_workers && current_worker_index() == detail::INVALID_WORKER_INDEX;
+            const uint32_t spin_count = Traits::WAIT_POLICY == WaitPolicy::SLEEP ? 0u : detail::WAIT_SPIN_COUNT;
+            uint32_t       spins = 0;
+
+            while (!done())
+            {
+                // Checked before taking another task, a busy queue must not keep a timed wait going.
+                if (deadline && std::chrono::steady_clock::now() >= *deadline)
+                    return done();
+
+                Task* task = can_help ? find_task() : nullptr;
+
+                if (task)
+                {
+                    run_task(task);
+                    spins = 0;
+                    continue;
+                }
+
+                if (spins < spin_count)
+                {
+                    spins++;
+                    cpu_pause();
+                    continue;
+                }
+
+                if (!can_sleep)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                if (task_waiters)
+                    task_waiters->fetch_add(1, std::memory_order_seq_cst);
+
+                const uint32_t key = m_completion.prepare_wait();
+
+                if (done())
+                    m_completion.cancel_wait();
+                else if (deadline)
+                    m_completion.commit_wait_until(key, *deadline);
+                else
+                    m_completion.commit_wait(key);
+
+                if (task_waiters)
+                    task_waiters->fetch_sub(1, std::memory_order_relaxed);
+
+                spins = 0;
+            }
+
+            return true;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Highest priority first. Every PRIORITY_AGING_INTERVAL picks a thread starts at a lower level instead
+        // (alternating between normal and background), so sustained critical load can't starve the rest.
+        inline Task* find_task()
+        {
+            ThreadContext& context = thread_context();
+            const bool     is_worker = context.pool == this;
+            const uint32_t worker_index = is_worker ? context.worker_index : detail::INVALID_WORKER_INDEX;
+            uint32_t       first_level = 0;
+
+            if ((++context.num_picks % detail::PRIORITY_AGING_INTERVAL) == 0)
+                first_level = 1 + (context.num_picks / detail::PRIORITY_AGING_INTERVAL) % (detail::NUM_TASK_PRIORITIES - 1);
+
+            for (uint32_t i = 0; i < detail::NUM_TASK_PRIORITIES; i++)
+            {
+                const uint32_t level = (first_level + i) % detail::NUM_TASK_PRIORITIES;
+                Task*          task = find_task(level, worker_index);
+
+                if (task)
+                    return task;
+            }
+
+            return nullptr;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Local deque first, then our node's queue and the injection queue, then steal (nearest victims first),
+        // and only then take work meant for other nodes. Only the local deque follows the level's QueueOrder.
+        inline Task* find_task(uint32_t level, uint32_t worker_index)
+        {
+            Task*    task = nullptr;
+            uint32_t numa_node = INVALID_NUMA_NODE;
+
+            if (worker_index != detail::INVALID_WORKER_INDEX)
+            {
+                Deque& deque = m_worker_threads[worker_index].m_deques[level];
+
+                // Taking from the top of our own deque gives FIFO order.
+                task = m_queue_orders[level].load(std::memory_order_relaxed) == QueueOrder::LIFO ? deque.pop() : deque.steal();
+
+                if (task)
+                    return task;
+
+                numa_node = m_worker_threads[worker_index].m_numa_node;
+
+                if (m_node_queues)
+                {
+                    task = m_node_queues[numa_node * detail::NUM_TASK_PRIORITIES + level].pop();
+
+                    if (task)
+                        return task;
+                }
+            }
+
+            task = m_injection_queues[level].pop();
+
+            if (task)
+                return task;
+
+            task = steal_task(level, worker_index);
+
+            if (task || !m_node_queues)
+                return task;
+
+            for (uint32_t i = 0; i < m_num_numa_nodes; i++)
+            {
+                if (i == numa_node)
+                    continue;
+
+                task = m_node_queues[i * detail::NUM_TASK_PRIORITIES + level].pop();
+
+                if (task)
+                    return task;
+            }
+
+            return nullptr;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline Task* steal_task(uint32_t level, uint32_t thief_index)
+        {
+            if (Traits::QUEUE_POLICY != QueuePolicy::WORK_STEALING || m_num_worker_threads == 0)
+                return nullptr;
+
+            ThreadContext& context = thread_context();
+
+            // xorshift32, state is per thread so there is no shared RNG to contend on.
+            uint32_t x = context.rng_state ? context.rng_state : 0x9E3779B9u;
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            context.rng_state = x;
+
+            // Threads outside the pool have no locality to preserve.
+            if (thief_index == detail::INVALID_WORKER_INDEX)
+            {
+                const uint32_t start = x % m_num_worker_threads;
+
+                for (uint32_t i = 0; i < m_num_worker_threads; i++)
+                {
+                    const uint32_t victim = (start + i) % m_num_worker_threads;
+
+                    if (!m_worker_threads[victim].m_active.load(std::memory_order_relaxed))
+                        continue;
+
+                    Task* task = m_worker_threads[victim].m_deques[level].steal();
+
+                    if (record_steal(task, victim))
+                        return task;
+                }
+
+                return nullptr;
+            }
+
+            // Random start within each distance tier, so neighbours are tried first without all piling onto one victim.
+            const WorkerThread& thief = m_worker_threads[thief_index];
+            uint32_t            begin = 0;
+
+            for (uint32_t tier = 0; tier < detail::NUM_STEAL_TIERS; tier++)
+            {
+                const uint32_t end = thief.m_victim_tiers[tier];
+                const uint32_t count = end - begin;
+
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    const uint32_t victim = thief.m_victims[begin + (x + i) % count];
+
+                    if (!m_worker_threads[victim].m_active.load(std::memory_order_relaxed))
+                        continue;
+
+                    Task* task = m_worker_threads[victim].m_deques[level].steal();
+
+                    if (record_steal(task, victim))
+                        return task;
+                }
+
+                begin = end;
+            }
+
+            return nullptr;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Counts a steal attempt, returns whether it got something.
+        inline bool record_steal(Task* task, uint32_t victim)
+        {
+            if (Traits::TRACE && task)
+                trace(TRACE_STEAL, trace_id(task), victim);
+
+            if (Traits::STATS)
+            {
+                WorkerCounters& stats = counters();
+                WorkerCounters::add(stats.steals_attempted, 1);
+
+                if (task)
+                    WorkerCounters::add(stats.steals_succeeded, 1);
+            }
+
+            return task != nullptr;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Pushes a task whose predecessors have all finished.
+        inline void push(Task* task)
+        {
+            const uint32_t num_pending = m_num_pending_tasks.fetch_add(1, std::memory_order_relaxed) + 1;
+
+            if (Traits::STATS)
+                task->ready_time.set(now_ns());
+
+            if (Traits::TRACE)
+                trace(TRACE_ENQUEUE, trace_id(task), 0);
+
+            // Workers push onto their own deque, everyone else goes through the injection queue.
+            ThreadContext& context = thread_context();
+
+            const uint32_t level = uint32_t(task->priority);
+            const bool     is_worker = context.pool == this;
+
+            // Node hinted tasks stay local if we are on that node, otherwise they go to the node's queue.
+            if (is_remote(task, is_worker ? m_worker_threads[context.worker_index].m_numa_node : INVALID_NUMA_NODE))
+                m_node_queues[task->numa_node * detail::NUM_TASK_PRIORITIES + level].push(task);
+            else if (!is_worker || !m_worker_threads[context.worker_index].m_deques[level].push(task))
+                m_injection_queues[level].push(task);
+            else if (Traits::STATS)
+                WorkerCounters::raise(counters().max_queue_depth, m_worker_threads[context.worker_index].m_deques[level].size());
+
+            // Only touches the parking lock if somebody is actually asleep. Its fence also orders the push before
+            // the worker count grow_if_needed() reads.
+            m_parking.notify_one();
+            grow_if_needed(num_pending);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Pushes tasks whose predecessors have all finished. Tasks of one priority that don't need to go to another
+        // node (the common case) are published straight from the array, anything else goes through small chunks.
+        inline void push_batch(Task** tasks, uint32_t count)
+        {
+            if (count == 0)
+                return;
+
+            const uint32_t num_pending = m_num_pending_tasks.fetch_add(count, std::memory_order_relaxed) + count;
+
+            if (Traits::STATS)
+            {
+                const uint64_t ready_time = now_ns();
+
+                for (uint32_t i = 0; i < count; i++)
+                    tasks[i]->ready_time.set(ready_time);
+            }
+
+            if (Traits::TRACE)
+            {
+                for (uint32_t i = 0; i < count; i++)
+                    trace(TRACE_ENQUEUE, trace_id(tasks[i]), 0);
+            }
+
+            ThreadContext& context = thread_context();
+            const bool     is_worker = context.pool == this;
+            const uint32_t numa_node = is_worker ? m_worker_threads[context.worker_index].m_numa_node : INVALID_NUMA_NODE;
+            const uint32_t first_level = uint32_t(tasks[0]->priority);
+            bool           is_uniform = true;
+
+            for (uint32_t i = 0; i < count && is_uniform; i++)
+                is_uniform = uint32_t(tasks[i]->priority) == first_level && !is_remote(tasks[i], numa_node);
+
+            if (is_uniform)
+                publish(tasks, count, first_level, is_worker);
+            else
+            {
+                Task* chunk[detail::TASK_BATCH_SIZE];
+
+                for (uint32_t level = 0; level < detail::NUM_TASK_PRIORITIES; level++)
+                {
+                    uint32_t num_chunk = 0;
+
+                    for (uint32_t i = 0; i < count; i++)
+                    {
+                        Task* task = tasks[i];
+
+                        if (uint32_t(task->priority) != level)
+                            continue;
+
+                        if (is_remote(task, numa_node))
+                            m_node_queues[task->numa_node * detail::NUM_TASK_PRIORITIES + level].push(task);
+                        else
+                        {
+                            chunk[num_chunk++] = task;
+
+                            if (num_chunk == detail::TASK_BATCH_SIZE)
+                            {
+                                publish(chunk, num_chunk, level, is_worker);
+                                num_chunk = 0;
+                            }
+                        }
+                    }
+
+                    publish(chunk, num_chunk, level, is_worker);
+                }
+            }
+
+            // Wakes at most one sleeper per task, and none if nobody is asleep.
+            m_parking.notify(count);
+            grow_if_needed(num_pending);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Whether a task is hinted to a NUMA node other than the given one (and has to go through that node's queue).
+        inline bool is_remote(Task* task, uint32_t numa_node)
+        {
+            return m_node_queues && task->numa_node < m_num_numa_nodes && task->numa_node != numa_node;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Own deque for workers, spilling into the injection queue once it is full.
+        inline void publish(Task** tasks, uint32_t count, uint32_t level, bool is_worker)
+        {
+            if (count == 0)
+                return;
+
+            uint32_t num_pushed = 0;
+
+            if (is_worker)
+            {
+                Deque& deque = m_worker_threads[thread_context().worker_index].m_deques[level];
+                num_pushed = deque.push_batch(tasks, count);
+
+                if (Traits::STATS)
+                    WorkerCounters::raise(counters().max_queue_depth, deque.size());
+            }
+
+            if (num_pushed < count)
+                m_injection_queues[level].push_batch(tasks + num_pushed, count - num_pushed);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline void resolve_predecessor(Task* task)
+        {
+            if ((task->num_predecessors.fetch_sub(1, std::memory_order_acq_rel) & detail::PREDECESSOR_COUNT_MASK) == 1)
+                push(task);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline bool add_successor(Task* parent, Task* child)
+        {
+            TaskEdges* parent_edges = edges(parent);
+
+            if (!parent_edges || parent_edges->num_successors >= TaskEdges::MAX_SUCCESSORS)
+                return false;
+
+            parent_edges->successors[parent_edges->num_successors++] = child;
+
+            return true;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Either the task's group was cancelled, or a task it waits for was skipped.
+        inline bool is_cancelled(Task* task)
+        {
+            return (task->num_predecessors.load(std::memory_order_relaxed) & detail::PREDECESSOR_CANCELLED) || (task->group && task->group->is_cancelled());
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Skips a cancelled task. Tasks that own their data (lambdas, futures) still get called, but only to destroy it.
+        inline void discard(Task* task)
+        {
+            task->flags |= detail::TASK_FLAG_SKIPPED;
+
+            if (task->flags & detail::TASK_FLAG_OWNS_DATA)
+            {
+                ThreadContext& context = thread_context();
+
+                context.discarding = true;
+                task->function(task->data);
+                context.discarding = false;
+            }
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // The task's own run is over. If none of its children are still open it is complete, which may in turn
+        // complete its parent, and so on up. Returns whether waiters have to be woken.
+        inline bool finish(Task* task)
+        {
+            // Tasks without children skip the read-modify-write, nobody else can touch the count then.
+            if (task->num_open.load(std::memory_order_acquire) != 1 && task->num_open.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return false;
+
+            bool notify = false;
+
+            for (;;)
+            {
+                // Read before complete(), which may recycle the task.
+                Task* parent = task->parent;
+                notify = complete(task) || notify;
+
+                if (!parent || parent->num_open.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                    return notify;
+
+                task = parent;
+            }
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        inline bool complete(Task* task)
+        {
+            const uint64_t trace_task = Traits::TRACE ? trace_id(task) : 0;
+
+            // then() may be adding a continuation to a future task right now, wait for it and keep any more out.
+            // The release publishes TASK_FLAG_SKIPPED to a then() that finds the edges sealed.
+            if (task->flags & detail::TASK_FLAG_FUTURE)
+            {
+                uint32_t expected = EDGES_OPEN;
+
+                while (!task->edge_state.compare_exchange_weak(expected, EDGES_SEALED, std::memory_order_acq_rel, std::memory_order_relaxed))
+                {
+                    expected = EDGES_OPEN;
+                    cpu_pause();
+                }
+            }
+
+            TaskEdges* task_edges = task->edges;
+
+            // Successors that have no other unfinished predecessors become runnable now, and get pushed together.
+            if (task_edges)
+            {
+                Task*      ready[TaskEdges::MAX_SUCCESSORS];
+                uint32_t   num_ready = 0;
+                const bool skipped = (task->flags & detail::TASK_FLAG_SKIPPED) != 0;
+
+                for (uint32_t i = 0; i < task_edges->num_successors; i++)
+                {
+                    Task* successor = task_edges->successors[i];
+
+                    // Before the decrement, afterwards the successor may already have run and been recycled.
+                    if (Traits::TRACE)
+                        trace(TRACE_RELEASE, trace_task, trace_id(successor));
+
+                    // Whatever waits on a skipped task is skipped as well.
+                    if (skipped)
+                        successor->num_predecessors.fetch_or(detail::PREDECESSOR_CANCELLED, std::memory_order_relaxed);
+
+                    if ((successor->num_predecessors.fetch_sub(1, std::memory_order_acq_rel) & detail::PREDECESSOR_COUNT_MASK) == 1)
+                        ready[num_ready++] = successor;
+                }
+
+                push_batch(ready, num_ready);
+            }
+
+            std::atomic<uint32_t>* counter = task->counter;
+            bool                   notify = false;
+
+            // Static tasks belong to a TaskGraph and are reset by the next run() instead of being recycled.
+            // The seq_cst decrements below pair with the waiter side of wait_until_done() without an extra fence.
+            if (task->flags & detail::TASK_FLAG_STATIC)
+            {
+                task->num_pending.exchange(0, std::memory_order_seq_cst);
+                notify = task->num_waiters.load(std::memory_order_seq_cst) != 0;
+            }
+            else
+            {
+                // Bump the generation before num_pending drops so a handle never sees a finished task as pending.
+                task->generation.fetch_add(1, std::memory_order_release);
+                task->num_pending--;
+                notify = task->num_waiters.load(std::memory_order_seq_cst) != 0;
+
+                release_ref(task);
+            }
+
+            if (counter && counter->fetch_sub(1, std::memory_order_seq_cst) == 1)
+                notify = notify || m_completion.has_waiters();
+
+            return notify;
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+		inline void run_task(Task* task)
+		{
+            const uint64_t start_time = Traits::STATS ? now_ns() : 0;
+            const uint64_t ready_time = task->ready_time.get();
+            const uint64_t trace_task = Traits::TRACE ? trace_id(task) : 0;
+
+            if (Traits::TRACE)
+                trace(TRACE_TASK_BEGIN, trace_task, uint64_t(uintptr_t(task->name.get())));
+
+            // Execute the current task. Everything it depends on has already finished, otherwise it wouldn't be queued.
+            if (is_cancelled(task))
+                discard(task);
+            else
+                task->function(task->data);
+
+            if (Traits::STATS)
+            {
+                const uint64_t  end_time = now_ns();
+                WorkerCounters& stats = counters();
+
+                WorkerCounters::add(stats.tasks_executed, 1);
+                WorkerCounters::add(stats.busy_ns, end_time - start_time);
+                WorkerCounters::add(stats.wait_latency[latency_bucket(start_time > ready_time ? start_time - ready_time : 0)], 1);
+                WorkerCounters::add(stats.run_latency[latency_bucket(end_time - start_time)], 1);
+            }
+
+            bool notify = finish(task);
+
+            if (Traits::TRACE)
+                trace(TRACE_TASK_END, trace_task, 0);
+
+            // Successors were counted above, so this can't reach zero while a chain is still in flight.
+            if (m_num_pending_tasks.fetch_sub(1, std::memory_order_seq_cst) == 1)
+                notify = notify || m_completion.has_waiters();
+
+            if (notify)
+                m_completion.notify_all();
+		}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        template <typename Body>
+        inline void run_parallel_range(Body& body, uint32_t begin, uint32_t end, uint32_t grain)
+        {
+            if (begin >= end)
+                return;
+
+            ParallelRange<Body> range;
+            range.body = &body;
+            range.grain = std::max(grain, 1u);
+            range.num_pending = 1;
+
+            execute_range(&range, begin, end);
+
+            // Help out until the ranges handed to other threads are done too, sleeping if there is nothing to help with.
+            wait_until_done(CounterDone(&range.num_pending), nullptr, nullptr);
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        template <typename Body>
+        inline void execute_range(ParallelRange<Body>* range, uint32_t begin, uint32_t end)
+        {
+            typename Body::Partial partial = range->body->identity();
+
+            while (end - begin > range->grain)
+            {
+                if (should_split_range())
+                {
+                    const uint32_t middle = begin + (end - begin) / 2;
+                    Task*          task = allocate([this, range, middle, end]() { execute_range(range, middle, end); });
+
+                    if (task)
+                    {
+                        range->num_pending.fetch_add(1, std::memory_order_relaxed);
+                        push(task);
+                        end = middle;
+                        continue;
+                    }
+                }
+
+                range->body->run(begin, begin + range->grain, partial);
+                begin += range->grain;
+            }
+
+            range->body->run(begin, end, partial);
+            range->body->combine(partial);
+
+            // The range lives on the caller's stack, it may be gone as soon as the count drops.
+            if (range->num_pending.fetch_sub(1, std::memory_order_seq_cst) == 1)
+                notify_waiters();
+        }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // execute_range() for parallel_reduce(). Each half split off gets a slot in this frame to leave its partial in,
+        // and is joined back once this call is through with its own part. The halves all lie to the right of what
+        // this call folds itself, the last one split closest, so they are joined last to first. The result goes to
+        // slot, with pending already dropped when called from parallel_reduce() directly.
+        template <typename Body>
+        inline void execute_reduce_range(ParallelRange<Body>* range, uint32_t begin, uint32_t end, ReduceSlot<typename Body::Partial>* slot)
+        {
+            typedef typename Body::Partial Partial;
+
+            // Every split halves the range, so a 32 bit range can't be split more often than this.
+            ReduceSlot<Partial> children[32];
+            uint32_t            num_children = 0;
+            Partial             partial = range->body->identity();
+
+            while (end - begin > range->grain)
+            {
+                if (num_children < 32 && should_split_range())
+                {
+                    const uint32_t       middle = begin + (end - begin) / 2;
+                    ReduceSlot<Partial>* child = &children[num_children];
+                    Task*                task = allocate([this, range, middle, end, child]() { execute_reduce_range(range, middle, end, child); });
+
+                    if (task)
+                    {
+                        child->pending.store(1, std::memory_order_relaxed);
+                        num_children++;
+                        push(task);
+                        end = middle;
+                        continue;
+                    }
+                }
+
+                range->body->run(begin, begin + range->grain, partial);
+                begin += range->grain;
+            }
 
-	inline void notify()
-	{
-		std::unique_lock<std::mutex> lock(m_mutex);
-		m_signal = true;
-		m_condition.notify_all();
-	}
+            range->body->run(begin, end, partial);
 
-	inline void wait()
-	{
-		std::unique_lock<std::mutex> lock(m_mutex);
-		m_condition.wait(lock, [&] { return m_signal; });
-		m_signal = false;
-	}
+            while (num_children > 0)
+            {
+                ReduceSlot<Partial>& child = children[--num_children];
 
-private:
+                wait_until_done(CounterDone(&child.pending), nullptr, nullptr);
+                range->body->join(partial, child.value());
+                child.value().~Partial();
+            }
 
-	Semaphore(const Semaphore &);
-	Semaphore & operator = (const Semaphore &);
+            new (&slot->storage) Partial(std::move(partial));
 
-	std::mutex              m_mutex;
-	std::condition_variable m_condition;
-	bool                    m_signal;
-};
+            // The slot lives on the splitting range's stack, it may be gone as soon as pending drops.
+            slot->pending.store(0, std::memory_order_seq_cst);
+            notify_waiters();
+        }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-    struct Task
-    {
-        std::function<void(void*)> function;
-        char				       data[TASK_SIZE_BYTES];
-        std::atomic<uint16_t>      num_pending;
-		uint16_t      num_continuations;
-        uint16_t      num_dependencies;
-        Task*                      dependencies[MAX_DEPENDENCIES];
-		Task*				       continuations[MAX_CONTINUATIONS];
-    };
-    
-// -----------------------------------------------------------------------------------------------------------------------------------
-    
-    template <typename T>
-    inline T* task_data(Task* task)
-    {
-        return (T*)(&task->data[0]);
-    }
-    
-// -----------------------------------------------------------------------------------------------------------------------------------
-    
-    struct WorkQueue
-    {
-        std::mutex			  m_critical_section;
-        Task				  m_task_pool[MAX_TASKS];
-        Task*				  m_task_queue[MAX_TASKS];
-        uint32_t			  m_front;
-        uint32_t			  m_back;
-        uint32_t			  m_num_tasks;
-		std::atomic<uint32_t> m_num_pending_tasks;
-        
-// -----------------------------------------------------------------------------------------------------------------------------------
-        
-        WorkQueue()
+        // Only split when somebody can pick up the other half: a worker is idle, or ours got stolen from. Without
+        // deques the shared queue running dry says the same.
+        inline bool should_split_range()
         {
-            m_num_tasks = 0;
-            m_num_pending_tasks = 0;
-            m_front = 0;
-            m_back = 0;
+            if (m_num_idle.load(std::memory_order_relaxed) > 0)
+                return true;
+
+            if (Traits::QUEUE_POLICY != QueuePolicy::WORK_STEALING)
+                return m_injection_queues[uint32_t(TaskPriority::NORMAL)].empty();
+
+            const uint32_t worker_index = current_worker_index();
+
+            return worker_index != detail::INVALID_WORKER_INDEX && m_worker_threads[worker_index].m_deques[uint32_t(TaskPriority::NORMAL)].empty();
         }
-        
-// -----------------------------------------------------------------------------------------------------------------------------------
-        
-        ~WorkQueue() {}
-        
+
 // -----------------------------------------------------------------------------------------------------------------------------------
-        
-        Task* allocate()
+
+        inline void release_ref(Task* task)
         {
-            uint32_t task_index = m_num_tasks++;
-            return &m_task_pool[task_index & (MAX_TASKS - 1u)];
+            if (task->num_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                const uint32_t worker_index = current_worker_index();
+
+                if (task->edges)
+                    m_edge_allocator.free(task->edges, worker_index);
+
+                m_task_allocator.free(task, worker_index);
+            }
         }
-        
+
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-        void push(Task* task)
+        // Returns the task's edge block, pulling one from the side pool the first time an edge is added.
+        inline TaskEdges* edges(Task* task)
         {
-            std::lock_guard<std::mutex> lock(m_critical_section);
-            
-            m_task_queue[m_back & MASK] = task;
-            ++m_back;
-            m_num_pending_tasks++;
+            if (!task->edges)
+            {
+                TaskEdges* task_edges = m_edge_allocator.allocate(current_worker_index());
+
+                if (task_edges)
+                    task_edges->num_successors = 0;
+
+                task->edges = task_edges;
+            }
+
+            return task->edges;
         }
-        
+
 // -----------------------------------------------------------------------------------------------------------------------------------
-        
-        Task* pop()
+
+        inline Task* resolve(TaskHandle task_handle)
         {
-            std::lock_guard<std::mutex> lock(m_critical_section);
-            
-            const uint32_t job_count = m_back - m_front;
-            if (job_count <= 0)
+            if (!m_task_allocator.is_valid(task_handle.index))
+                return nullptr;
+
+            Task* task = m_task_allocator.get(task_handle.index);
+
+            if (task->generation.load(std::memory_order_acquire) != task_handle.generation)
                 return nullptr;
-            
-            --m_back;
-            return m_task_queue[m_back & MASK];
+
+            return task;
         }
-        
+
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-        bool has_pending_tasks()
+        template <typename Callable>
+        static void invoke_callable(void* data)
         {
-            return (m_num_pending_tasks != 0);
+            Callable* callable = static_cast<Callable*>(data);
+
+            if (!thread_context().discarding)
+                (*callable)();
+
+            callable->~Callable();
         }
-        
+
 // -----------------------------------------------------------------------------------------------------------------------------------
-        
-        bool empty()
+
+        // Allocates a task that stores what callable returns. It starts out with a second reference, owned by the
+        // Future, so the slot (and the result in it) outlives the task.
+        template <typename Result, typename F>
+        inline Task* allocate_future(F&& callable)
         {
-            return (m_front == 0 && m_back == 0);
+            typedef typename std::decay<F>::type Callable;
+
+            static_assert(sizeof(Callable) <= Traits::TASK_SIZE_BYTES - detail::FUTURE_STORAGE_OFFSET, "Callable does not fit in a future task");
+            static_assert(FutureStorage<Result>::size <= Traits::TASK_SIZE_BYTES - detail::FUTURE_STORAGE_OFFSET, "Result does not fit in a future task");
+            static_assert(alignof(Callable) <= 16 && FutureStorage<Result>::alignment <= 16, "Callable or result is over-aligned for the task data");
+
+            Task* task_ptr = allocate();
+
+            if (!task_ptr)
+                return nullptr;
+
+            new (task_ptr->data) std::atomic<uint32_t>(FUTURE_PENDING);
+            new (task_ptr->data + detail::FUTURE_STORAGE_OFFSET) Callable(std::forward<F>(callable));
+            task_ptr->function = &invoke_future<Callable, Result>;
+            task_ptr->flags |= detail::TASK_FLAG_FUTURE | detail::TASK_FLAG_OWNS_DATA;
+            task_ptr->num_refs.store(2, std::memory_order_relaxed);
+
+            return task_ptr;
         }
-    };
-    
-// -----------------------------------------------------------------------------------------------------------------------------------
-    
-    struct WorkerThread
-    {
-		Semaphore	m_wakeup;
-        Semaphore	m_done;
-        std::thread m_thread;
-		        
-// -----------------------------------------------------------------------------------------------------------------------------------
 
-		WorkerThread() {}
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-		WorkerThread(const WorkerThread &) {}
-        
+        static inline std::atomic<uint32_t>& future_state(Task* task)
+        {
+            return *reinterpret_cast<std::atomic<uint32_t>*>(task->data);
+        }
+
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-        ~WorkerThread()
+        template <typename T>
+        static inline T* future_value(Task* task)
         {
-            wakeup();
-            m_thread.join();
+            return reinterpret_cast<T*>(task->data + detail::FUTURE_STORAGE_OFFSET);
         }
-        
+
 // -----------------------------------------------------------------------------------------------------------------------------------
-        
-        void wakeup()
+
+        template <typename Callable, typename Result>
+        static void invoke_future(void* data)
         {
-            m_wakeup.notify();
+            char*     storage = static_cast<char*>(data) + detail::FUTURE_STORAGE_OFFSET;
+            Callable* callable = reinterpret_cast<Callable*>(storage);
+
+            // Skipped because of a cancellation: no result, the future reports is_cancelled() instead.
+            if (thread_context().discarding)
+            {
+                callable->~Callable();
+                static_cast<std::atomic<uint32_t>*>(data)->exchange(FUTURE_CANCELLED, std::memory_order_acq_rel);
+                return;
+            }
+
+            store_result<Callable, Result>(callable, storage, std::is_void<Result>());
+
+            if (static_cast<std::atomic<uint32_t>*>(data)->exchange(FUTURE_READY, std::memory_order_acq_rel) == FUTURE_ABANDONED)
+                destroy_result<Result>(storage, std::is_void<Result>());
         }
-    };
-    
-// -----------------------------------------------------------------------------------------------------------------------------------
-    
-    class ThreadPool
-    {
-    public:
-        
+
 // -----------------------------------------------------------------------------------------------------------------------------------
-        
-        ThreadPool()
+
+        // The result takes the place of the callable, so it is moved out before the callable goes away.
+        template <typename Callable, typename Result>
+        static inline void store_result(Callable* callable, char* storage, std::false_type)
         {
-            m_shutdown = false;
-            
-            // get number of logical threads on CPU
-            m_num_logical_threads = std::thread::hardware_concurrency();
-            
-            m_num_worker_threads = m_num_logical_threads;
-            
-			initialize_workers();
+            Result result((*callable)());
+            callable->~Callable();
+            new (storage) Result(std::move(result));
         }
-        
-// -----------------------------------------------------------------------------------------------------------------------------------
-        
-        ThreadPool(uint32_t workers)
+
+        template <typename Callable, typename Result>
+        static inline void store_result(Callable* callable, char*, std::true_type)
         {
-            m_shutdown = false;
-            
-            // get number of logical threads on CPU
-            m_num_logical_threads = std::thread::hardware_concurrency();
-            m_num_worker_threads = std::min(workers, m_num_logical_threads);
-            
-			initialize_workers();
+            (*callable)();
+            callable->~Callable();
         }
-        
+
 // -----------------------------------------------------------------------------------------------------------------------------------
-        
-        ~ThreadPool()
+
+        template <typename Result>
+        static inline void destroy_result(char* storage, std::false_type)
         {
-			m_shutdown = true;
-			m_worker_threads.clear();
+            reinterpret_cast<Result*>(storage)->~Result();
         }
-        
+
+        template <typename Result>
+        static inline void destroy_result(char*, std::true_type) {}
+
 // -----------------------------------------------------------------------------------------------------------------------------------
-        
-        inline Task* allocate()
+
+        // Drops the future's reference, destroying the result if the task already published it.
+        template <typename T>
+        inline void release_future(Task* task)
         {
-            Task* task_ptr = m_queue.allocate();
-            task_ptr->num_pending = 1;
-			task_ptr->num_continuations = 0;
-			task_ptr->num_dependencies = 0;
-            return task_ptr;
+            if (future_state(task).exchange(FUTURE_ABANDONED, std::memory_order_acq_rel) == FUTURE_READY)
+                destroy_result<T>(task->data + detail::FUTURE_STORAGE_OFFSET, std::is_void<T>());
+
+            release_ref(task);
         }
-        
-// -----------------------------------------------------------------------------------------------------------------------------------
-        
-		inline void define_dependency(Task* child, Task* parent)
-		{
-			if (parent && child)
-				child->dependencies[child->num_dependencies++] = parent;
-		}
-        
+
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-		inline void define_continuation(Task* parent, Task* continuation)
-		{
-			if (parent && continuation)
-			{
-				if (parent->num_continuations < MAX_CONTINUATIONS)
-				{
-					parent->continuations[parent->num_continuations] = continuation;
-					parent->num_continuations++;
-				}
-			}
-		}
-        
+        // Runs function on the parent's result once it is ready. Owns the parent's future reference, which it
+        // drops when the task destroys it, whether function ran or the task was skipped.
+        template <typename T, typename F>
+        struct ThenCallable
+        {
+            BasicThreadPool* pool;
+            Task*            parent;
+            F                function;
+
+            template <typename G>
+            ThenCallable(BasicThreadPool* p, Task* parent_task, G&& g) : pool(p), parent(parent_task), function(std::forward<G>(g)) {}
+
+            ThenCallable(ThenCallable&& other) : pool(other.pool), parent(other.parent), function(std::move(other.function))
+            {
+                other.parent = nullptr;
+            }
+
+            // The task destroys its callable whether it ran or was skipped, either way the parent is released.
+            ~ThenCallable()
+            {
+                if (parent)
+                    pool->template release_future<T>(parent);
+            }
+
+            typename ThenResult<T, F>::type operator()()
+            {
+                return ThenInvoke<T>::call(function, parent->data + detail::FUTURE_STORAGE_OFFSET);
+            }
+        };
+
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-        inline void enqueue(Task* task)
+        // Implements Future::then(). Takes over the parent's future reference and hooks the new task up as a
+        // continuation of the parent, or enqueues it straight away if the parent has already finished.
+        template <typename T, typename F>
+        inline Future<typename ThenResult<T, F>::type, Traits> then(Task* parent, F&& function)
         {
-            if (task)
+            typedef ThenCallable<T, typename std::decay<F>::type> Callable;
+            typedef typename ThenResult<T, F>::type               Result;
+
+            // If the pool is out of tasks the callable never moves, and releases the parent on the way out.
+            Callable callable(this, parent, std::forward<F>(function));
+            Task*    task_ptr = allocate_future<Result>(std::move(callable));
+
+            if (!task_ptr)
+                return Future<Result, Traits>(this, nullptr);
+
+            task_ptr->priority = parent->priority;
+
+            if (!add_late_continuation(parent, task_ptr))
             {
-                m_queue.push(task);
+                // Out of edge capacity, fall back to waiting for the parent here.
+                wait_for_one(parent);
+                enqueue_after_future(parent, task_ptr);
+            }
+
+            return Future<Result, Traits>(this, task_ptr);
+        }
 
-                for(uint32_t i = 0; i < m_num_worker_threads; i++)
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Safe while parent runs. Returns false only if the parent is out of edge capacity.
+        inline bool add_late_continuation(Task* parent, Task* continuation)
+        {
+            uint32_t expected = EDGES_OPEN;
+
+            while (!parent->edge_state.compare_exchange_weak(expected, EDGES_LOCKED, std::memory_order_acquire, std::memory_order_acquire))
+            {
+                if (expected == EDGES_SEALED)
                 {
-                    WorkerThread& thread = m_worker_threads[i];
-                    thread.wakeup();
+                    // Parent already released its successors, so the continuation is ready to go.
+                    enqueue_after_future(parent, continuation);
+                    return true;
                 }
+
+                expected = EDGES_OPEN;
+                cpu_pause();
             }
+
+            const bool added = define_continuation(parent, continuation);
+            parent->edge_state.store(EDGES_OPEN, std::memory_order_release);
+
+            return added;
         }
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-		inline bool is_done(Task* task)
-		{
-			return task->num_pending == 0;
-		}
-        
+        // Enqueues a continuation of a parent that has already completed, skipping it too if the parent was skipped.
+        inline void enqueue_after_future(Task* parent, Task* continuation)
+        {
+            if (parent->flags & detail::TASK_FLAG_SKIPPED)
+                continuation->num_predecessors.fetch_or(detail::PREDECESSOR_CANCELLED, std::memory_order_relaxed);
+
+            enqueue(continuation);
+        }
+
 // -----------------------------------------------------------------------------------------------------------------------------------
-        
-        inline void wait_for_all()
+
+        // Task data of tasks whose parameters live in the frame arena.
+        struct PayloadCall
+        {
+            TaskFunction function;
+            void*        payload;
+#if THREAD_POOL_ARENA_CHECKS
+            BasicThreadPool* pool;
+            uint32_t         epoch;
+#endif
+        };
+
+        static void invoke_payload(void* data)
         {
-            while (m_queue.has_pending_tasks())
+            PayloadCall* call = static_cast<PayloadCall*>(data);
+
+#if THREAD_POOL_ARENA_CHECKS
+            if (call->pool->m_arena_epoch.load(std::memory_order_relaxed) != call->epoch || !LinearArena::is_live(call->payload, call->epoch))
             {
-                Task* task = m_queue.pop();
-                
-                if (task)
-                    run_task(task);
+                fprintf(stderr, "dw::ThreadPool: task payload used after reset_frame_arena()\n");
+                abort();
             }
+#endif
+
+            call->function(call->payload);
         }
-        
+
 // -----------------------------------------------------------------------------------------------------------------------------------
-        
-        inline void wait_for_one(Task* pending_task)
+
+    private:
+        // Slabs never hold more tasks than the pool may have alive at once.
+        static const uint32_t TASK_SLAB_CAPACITY = Traits::MAX_TASKS < detail::TASK_SLAB_SIZE ? Traits::MAX_TASKS : detail::TASK_SLAB_SIZE;
+
+        static_assert(Traits::MAX_TASKS != 0 && Traits::MAX_TASKS < detail::INVALID_TASK_INDEX, "MAX_TASKS has to be between 1 and 2^32 - 2");
+        static_assert(Traits::MAX_TASKS % TASK_SLAB_CAPACITY == 0, "MAX_TASKS above the slab size has to be a multiple of it");
+        static_assert(Traits::TRACE_BUFFER_SIZE != 0, "TRACE_BUFFER_SIZE can't be zero");
+
+        typedef SlabAllocator<Task, TASK_SLAB_CAPACITY, Traits::MAX_TASKS / TASK_SLAB_CAPACITY> TaskAllocator;
+        typedef SlabAllocator<TaskEdges, Traits::EDGE_SLAB_SIZE, detail::MAX_EDGE_SLABS>         EdgeAllocator;
+        typedef TraceBuffer<Traits::TRACE_BUFFER_SIZE>                                           TraceRing;
+
+        std::atomic<bool>                        m_shutdown;
+        uint32_t                                 m_num_logical_threads;
+        TaskAllocator                            m_task_allocator;
+        EdgeAllocator                            m_edge_allocator;
+        FrameAllocator                           m_frame_allocator;
+        std::unique_ptr<LinearArena[]>           m_arenas; // Same layout as m_counters.
+        std::atomic<uint32_t>                    m_arena_epoch;
+        std::mutex                               m_external_arena_mutex;
+        SharedQueue                              m_injection_queues[detail::NUM_TASK_PRIORITIES]; // Everything but the worker deques.
+        std::atomic<QueueOrder>                  m_queue_orders[detail::NUM_TASK_PRIORITIES]; // Read by workers, set_queue_order() may change it.
+        EventCount                               m_parking;
+        EventCount                               m_completion; // Threads outside the pool sleeping in a wait_*() call.
+        std::atomic<uint32_t>                    m_num_idle;
+        std::atomic<uint32_t>                    m_num_pending_tasks;
+        std::unique_ptr<SharedQueue[]>           m_node_queues; // NUM_TASK_PRIORITIES per NUMA node, only with more than one node.
+        std::unique_ptr<WorkerThread[]>          m_worker_threads;
+        uint32_t                                 m_num_worker_threads; // Worker slots, the most workers that can run at once.
+        std::atomic<uint32_t>                    m_num_live_workers;
+        std::atomic<uint32_t>                    m_min_workers;
+        std::atomic<uint32_t>                    m_max_workers;
+        std::mutex                               m_resize_mutex; // Starting and retiring workers.
+        uint32_t                                 m_num_numa_nodes;
+        WorkerAffinity                           m_affinity;
+        CpuTopology                              m_topology;
+        std::unique_ptr<WorkerCounters[]>        m_counters; // One per worker plus one shared by outside threads, only with Traits::STATS.
+        std::unique_ptr<TraceRing[]>             m_trace_buffers; // Same layout as m_counters, only with Traits::TRACE.
+        std::atomic<bool>                        m_tracing;
+    };
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    template <typename Pool>
+    template <typename Handle>
+    inline bool ScheduleAwaiter<Pool>::await_suspend(Handle handle)
+    {
+        struct Resume
         {
-            while (pending_task->num_pending > 0)
+            static void execute(void* data)
             {
-                Task* task = m_queue.pop();
-                
-                if (task)
-                    run_task(task);
+                Handle::from_address(*static_cast<void**>(data)).resume();
+            }
+        };
+
+        typename Pool::Task* task = pool->allocate(priority);
+
+        // Out of tasks, just keep running on the current thread.
+        if (!task)
+            return false;
+
+        *task_data<void*>(task) = handle.address();
+        task->function = &Resume::execute;
+        pool->enqueue(task);
+
+        return true;
+    }
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Result of ThreadPool::submit() for callables returning a value. Move-only; the task slot holding the result
+    // stays allocated until the future is dropped (or handed to then()), so there is no other allocation involved.
+    template <typename T, typename Traits>
+    class Future
+    {
+    public:
+        Future() : m_pool(nullptr), m_task(nullptr) {}
+
+        Future(Future&& other) : m_pool(other.m_pool), m_task(other.m_task)
+        {
+            other.m_task = nullptr;
+        }
+
+        Future& operator=(Future&& other)
+        {
+            if (this != &other)
+            {
+                reset();
+                m_pool = other.m_pool;
+                m_task = other.m_task;
+                other.m_task = nullptr;
             }
+
+            return *this;
         }
-        
+
+        ~Future()
+        {
+            reset();
+        }
+
 // -----------------------------------------------------------------------------------------------------------------------------------
-        
-        inline uint32_t num_logical_threads()
+
+        // False for default constructed futures, ones that have been moved from or handed to then(), and ones
+        // returned when the pool was out of tasks.
+        inline bool valid() const
         {
-            return m_num_logical_threads;
+            return m_task != nullptr;
         }
-        
+
 // -----------------------------------------------------------------------------------------------------------------------------------
-        
-        inline uint32_t num_worker_threads()
+
+        inline bool is_ready() const
         {
-            return m_num_worker_threads;
+            return m_task->num_pending.load(std::memory_order_acquire) == 0;
         }
-        
+
 // -----------------------------------------------------------------------------------------------------------------------------------
-        
-    private:
-        
+
+        // True once the task was skipped because of a cancellation. There is no result then, so get() must not be used.
+        inline bool is_cancelled() const
+        {
+            return is_ready() && BasicThreadPool<Traits>::future_state(m_task).load(std::memory_order_acquire) == FUTURE_CANCELLED;
+        }
+
 // -----------------------------------------------------------------------------------------------------------------------------------
-        
-        inline void initialize_workers()
+
+        // Helps executing tasks until the result is there. The reference stays valid as long as the future does.
+        inline typename std::add_lvalue_reference<T>::type get()
         {
-            // spawn worker threads
-            m_worker_threads.resize(m_num_worker_threads);
-            
-            for (uint32_t i = 0; i < m_num_worker_threads; i++)
-                m_worker_threads[i].m_thread = std::thread(&ThreadPool::worker, this, i);
+            m_pool->wait_for_one(m_task);
+            return result(std::is_void<T>());
         }
-        
+
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-		inline void worker(uint32_t index)
-		{
-			WorkerThread& worker_thread = m_worker_threads[index];
+        template <typename Rep, typename Period>
+        inline bool wait_for(const std::chrono::duration<Rep, Period>& timeout)
+        {
+            return m_pool->wait_for(m_task, timeout);
+        }
 
-			while (!m_shutdown)
-			{
-				Task* task = m_queue.pop();
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+        // Runs function(result) (function() for Future<void>) as a continuation of this task and returns a future
+        // for what it returns. This future becomes invalid; the continuation keeps the result alive until it ran.
+        template <typename F>
+        inline Future<typename ThenResult<T, F>::type, Traits> then(F&& function)
+        {
+            BasicTask<Traits>* task = m_task;
+            m_task = nullptr;
+
+            return m_pool->template then<T>(task, std::forward<F>(function));
+        }
 
-				if (!task)
-				{
-					worker_thread.m_done.notify();
-					worker_thread.m_wakeup.wait();
-				}
-				else
-					run_task(task);
-			}
-		}
-        
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-		inline void run_task(Task* task)
-		{
-            // Wait untill all of dependent tasks are done
-            wait_for_dependencies(task);
+    private:
+        template <typename>
+        friend class BasicThreadPool;
+
+        Future(BasicThreadPool<Traits>* pool, BasicTask<Traits>* task) : m_pool(pool), m_task(task) {}
 
-            // Execute the current task
-			task->function(task->data);
+        Future(const Future&);
+        Future& operator=(const Future&);
 
-			// Submit continuation tasks.
-			for (uint32_t i = 0; i < task->num_continuations; i++)
-				enqueue(task->continuations[i]);
+        inline void reset()
+        {
+            if (m_task)
+                m_pool->template release_future<T>(m_task);
 
-			if (task->num_pending > 0)
-				task->num_pending--;
+            m_task = nullptr;
+        }
 
-			if (m_queue.m_num_pending_tasks > 0)
-				m_queue.m_num_pending_tasks--;
-		}
-        
-// -----------------------------------------------------------------------------------------------------------------------------------
+        template <typename U = T>
+        inline U& result(std::false_type)
+        {
+            return *BasicThreadPool<Traits>::template future_value<U>(m_task);
+        }
 
-		inline void wait_for_dependencies(Task* task)
-		{
-            if (task->num_dependencies > 0)
-            {
-                for (uint32_t i = 0; i < task->num_dependencies; i++)
-                {
-                    while (task->dependencies[i]->num_pending > 0)
-                    {
-                        Task* wait_task = m_queue.pop();
+        inline void result(std::true_type) {}
 
-                        if (wait_task)
-                            run_task(wait_task);
-                    }
-                }
-            }
-		}
-        
-// -----------------------------------------------------------------------------------------------------------------------------------
-        
-    private:
-        bool					   m_shutdown;
-        uint32_t				   m_num_logical_threads;
-        WorkQueue                  m_queue;
-        std::vector<WorkerThread>  m_worker_threads;
-        uint32_t                   m_num_worker_threads;
+        BasicThreadPool<Traits>* m_pool;
+        BasicTask<Traits>*       m_task;
     };
 } // namespace dw